@@ -0,0 +1,464 @@
+/*
+ * Benchmark of the scope kernels on synthetic frames or on frames recorded from OBS Studio.
+ * This program does not depend on libobs so that it runs without OBS Studio.
+ *
+ * Usage: color-monitor-bench [--format text|csv|json] [--iterations N] [--filter SUBSTRING] [--replay FILE]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "synthetic-frame.h"
+#include "histogram-kernel.h"
+#include "histogram-tiles.h"
+#include "waveform-kernel.h"
+#include "vectorscope-kernel.h"
+#include "yuv-convert.h"
+#include "frame-record.h"
+
+#define MIN_DURATION_NS 200000000ULL
+#define MAX_ITERATIONS 1000
+
+enum output_format {
+	FORMAT_TEXT,
+	FORMAT_CSV,
+	FORMAT_JSON,
+};
+
+struct bench_resolution
+{
+	const char *name;
+	uint32_t width, height;
+};
+
+static const struct bench_resolution resolutions[] = {
+	{"720p", 1280, 720},
+	{"1080p", 1920, 1080},
+	{"uhd", 3840, 2160},
+};
+
+#define N_RESOLUTIONS (sizeof(resolutions) / sizeof(*resolutions))
+
+struct bench_components
+{
+	const char *name;
+	uint32_t components;
+};
+
+// Same bits as the `components` property of the histogram and the waveform.
+static const struct bench_components components_list[] = {
+	{"rgb", 0x07},
+	{"y", 0x20},
+	{"uv", 0x50},
+	{"yuv", 0x70},
+};
+
+#define N_COMPONENTS (sizeof(components_list) / sizeof(*components_list))
+
+static struct
+{
+	enum output_format format;
+	uint32_t iterations; // 0 to run until MIN_DURATION_NS elapsed
+	const char *filter;
+	const char *replay;
+	int n_results;
+} opt;
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (uint64_t)((double)t.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+struct bench_case
+{
+	const char *kernel;
+	const char *mode;
+	void (*func)(const struct bench_case *c, const struct synthetic_frame *frame);
+	uint32_t components;
+	uint32_t columns; // waveform only, 0 for native
+};
+
+// A set of frames measured together; one synthetic frame, or all frames of a recording.
+struct bench_input
+{
+	const char *pattern;
+	const char *resolution;
+	const struct synthetic_frame *frames;
+	uint32_t n_frames;
+	uint32_t width, height; // of the first frame
+};
+
+static union {
+	uint32_t his[256 * 4];
+	uint8_t vss[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+} dbuf;
+
+static uint8_t *wvs_out;
+static uint8_t *yuv_out;
+
+static void run_histogram(const struct bench_case *c, const struct synthetic_frame *frame)
+{
+	memset(dbuf.his, 0, sizeof(dbuf.his));
+	his_kernel_accumulate(dbuf.his, &frame->sd, c->components, 0, frame->sd.height);
+}
+
+/*
+ * Same as the plugin with the tiles; only the tiles changed since the previous frame are accumulated.
+ * A synthetic frame does not change so that this measures the steady state of static content.
+ */
+static struct his_tiles tiles;
+
+static void run_histogram_tiles(const struct bench_case *c, const struct synthetic_frame *frame)
+{
+	const uint32_t n_rows = his_tiles_begin(&tiles, &frame->sd, c->components);
+	memset(dbuf.his, 0, sizeof(dbuf.his));
+	his_tiles_update(&tiles, dbuf.his, &frame->sd, 0, n_rows);
+	his_tiles_commit(&tiles, dbuf.his);
+}
+
+static void run_waveform(const struct bench_case *c, const struct synthetic_frame *frame)
+{
+	uint32_t out_width = c->columns && c->columns < frame->sd.width ? c->columns : frame->sd.width;
+	wvs_kernel_columns(wvs_out, &frame->sd, c->components, out_width, 0, out_width);
+}
+
+static void run_vectorscope(const struct bench_case *c, const struct synthetic_frame *frame)
+{
+	(void)c;
+	memset(dbuf.vss, 0, sizeof(dbuf.vss));
+	vss_kernel_rows(dbuf.vss, &frame->sd, 0, frame->sd.height);
+}
+
+static void run_rgb2yuv(const struct bench_case *c, const struct synthetic_frame *frame)
+{
+	const struct cm_surface_data *sd = &frame->sd;
+	uint8_t *uv_out = yuv_out + (size_t)sd->width * sd->height;
+	if (!strcmp(c->mode, "scalar"))
+		cm_rgb_to_yuv_scalar(yuv_out, sd->width, uv_out, sd->width * 2, sd->rgb_data, sd->linesize, sd->width,
+				     sd->height, false);
+	else
+		cm_rgb_to_yuv(yuv_out, sd->width, uv_out, sd->width * 2, sd->rgb_data, sd->linesize, sd->width,
+			      sd->height, false);
+}
+
+static void report(const struct bench_case *c, const struct bench_input *in, uint64_t pixels_per_iteration,
+		   uint32_t iterations, uint64_t total_ns, uint64_t min_ns)
+{
+	const double pixels = (double)pixels_per_iteration;
+	const double ns_px_mean = (double)total_ns / iterations / pixels;
+	const double ns_px_min = (double)min_ns / pixels;
+	const double mpx_s = ns_px_mean > 0.0 ? 1e3 / ns_px_mean : 0.0;
+
+	switch (opt.format) {
+	case FORMAT_JSON:
+		printf("{\"kernel\":\"%s\",\"mode\":\"%s\",\"pattern\":\"%s\",\"resolution\":\"%s\","
+		       "\"width\":%u,\"height\":%u,\"frames\":%u,\"iterations\":%u,"
+		       "\"ns_per_pixel\":%.4f,\"ns_per_pixel_min\":%.4f,\"mpixels_per_s\":%.1f}\n",
+		       c->kernel, c->mode, in->pattern, in->resolution, in->width, in->height, in->n_frames,
+		       iterations, ns_px_mean, ns_px_min, mpx_s);
+		break;
+	case FORMAT_CSV:
+		if (!opt.n_results)
+			printf("kernel,mode,pattern,resolution,width,height,frames,iterations,"
+			       "ns_per_pixel,ns_per_pixel_min,mpixels_per_s\n");
+		printf("%s,%s,%s,%s,%u,%u,%u,%u,%.4f,%.4f,%.1f\n", c->kernel, c->mode, in->pattern, in->resolution,
+		       in->width, in->height, in->n_frames, iterations, ns_px_mean, ns_px_min, mpx_s);
+		break;
+	default:
+		if (!opt.n_results)
+			printf("%-12s %-12s %-12s %-6s %6s %10s %10s %10s\n", "kernel", "mode", "pattern", "res",
+			       "iter", "ns/px", "min ns/px", "Mpx/s");
+		printf("%-12s %-12s %-12s %-6s %6u %10.4f %10.4f %10.1f\n", c->kernel, c->mode, in->pattern,
+		       in->resolution, iterations, ns_px_mean, ns_px_min, mpx_s);
+		break;
+	}
+	fflush(stdout);
+	opt.n_results++;
+}
+
+static bool match_filter(const struct bench_case *c, const struct bench_input *in)
+{
+	if (!opt.filter)
+		return true;
+
+	char name[256];
+	snprintf(name, sizeof(name), "%s/%s/%s/%s", c->kernel, c->mode, in->pattern, in->resolution);
+	return strstr(name, opt.filter) != NULL;
+}
+
+// Recorded frames may not have all planes.
+static bool has_planes(const struct bench_case *c, const struct cm_surface_data *sd)
+{
+	if (!strcmp(c->kernel, "rgb2yuv") || (c->components & 0x07))
+		return sd->rgb_data != NULL;
+	if (!strcmp(c->kernel, "vectorscope") || (c->components & 0x50))
+		if (!sd->u_data)
+			return false;
+	if (c->components & 0x20)
+		return sd->y_data != NULL;
+	return true;
+}
+
+static uint64_t run_frames(const struct bench_case *c, const struct bench_input *in)
+{
+	uint64_t pixels = 0;
+	for (uint32_t i = 0; i < in->n_frames; i++) {
+		const struct synthetic_frame *frame = &in->frames[i];
+		if (!has_planes(c, &frame->sd))
+			continue;
+		c->func(c, frame);
+		pixels += (uint64_t)frame->sd.width * frame->sd.height;
+	}
+	return pixels;
+}
+
+static void run_case(const struct bench_case *c, const struct bench_input *in)
+{
+	if (!match_filter(c, in))
+		return;
+
+	// Warm up the caches and the branch predictors.
+	const uint64_t pixels = run_frames(c, in);
+	if (!pixels)
+		return;
+
+	uint64_t total_ns = 0, min_ns = UINT64_MAX;
+	uint32_t n = 0;
+	while (opt.iterations ? n < opt.iterations : (total_ns < MIN_DURATION_NS && n < MAX_ITERATIONS)) {
+		uint64_t t0 = now_ns();
+		run_frames(c, in);
+		uint64_t t = now_ns() - t0;
+		total_ns += t;
+		if (t < min_ns)
+			min_ns = t;
+		n++;
+	}
+
+	report(c, in, pixels, n, total_ns, min_ns);
+}
+
+static const struct bench_case *build_cases(size_t *n_cases)
+{
+	static struct bench_case cases[N_COMPONENTS * 4 + 3];
+	static char modes[N_COMPONENTS][32];
+	static char tiles_modes[N_COMPONENTS][32];
+	size_t n = 0;
+
+	for (size_t i = 0; i < N_COMPONENTS; i++) {
+		cases[n++] = (struct bench_case){
+			.kernel = "histogram",
+			.mode = components_list[i].name,
+			.func = run_histogram,
+			.components = components_list[i].components,
+		};
+		snprintf(tiles_modes[i], sizeof(tiles_modes[i]), "%s-tiles", components_list[i].name);
+		cases[n++] = (struct bench_case){
+			.kernel = "histogram",
+			.mode = tiles_modes[i],
+			.func = run_histogram_tiles,
+			.components = components_list[i].components,
+		};
+	}
+
+	for (size_t i = 0; i < N_COMPONENTS; i++) {
+		cases[n++] = (struct bench_case){
+			.kernel = "waveform",
+			.mode = components_list[i].name,
+			.func = run_waveform,
+			.components = components_list[i].components,
+		};
+		snprintf(modes[i], sizeof(modes[i]), "%s-512", components_list[i].name);
+		cases[n++] = (struct bench_case){
+			.kernel = "waveform",
+			.mode = modes[i],
+			.func = run_waveform,
+			.components = components_list[i].components,
+			.columns = 512,
+		};
+	}
+
+	cases[n++] = (struct bench_case){.kernel = "vectorscope", .mode = "uv", .func = run_vectorscope};
+	cases[n++] = (struct bench_case){.kernel = "rgb2yuv", .mode = "scalar", .func = run_rgb2yuv};
+	cases[n++] = (struct bench_case){.kernel = "rgb2yuv", .mode = "simd", .func = run_rgb2yuv};
+
+	*n_cases = n;
+	return cases;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --format text|csv|json  output format, one result in one line for csv and json (default: text)\n"
+		"  --iterations N          number of iterations for each case (default: run at least 200 ms)\n"
+		"  --filter SUBSTRING      run only cases whose kernel/mode/pattern/resolution contains SUBSTRING\n"
+		"  --replay FILE           run on the frames recorded by start_frame_recording instead of synthetic "
+		"frames\n",
+		argv0);
+}
+
+static bool parse_args(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+		if (!strcmp(arg, "--format") && next) {
+			i++;
+			if (!strcmp(next, "text"))
+				opt.format = FORMAT_TEXT;
+			else if (!strcmp(next, "csv"))
+				opt.format = FORMAT_CSV;
+			else if (!strcmp(next, "json"))
+				opt.format = FORMAT_JSON;
+			else
+				return false;
+		} else if (!strcmp(arg, "--iterations") && next) {
+			i++;
+			opt.iterations = (uint32_t)strtoul(next, NULL, 0);
+		} else if (!strcmp(arg, "--filter") && next) {
+			i++;
+			opt.filter = next;
+		} else if (!strcmp(arg, "--replay") && next) {
+			i++;
+			opt.replay = next;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool alloc_outputs(uint32_t max_width, uint64_t max_pixels)
+{
+	wvs_out = malloc((size_t)max_width * WVS_KERNEL_SIZE * 4);
+	yuv_out = malloc((size_t)max_pixels * 3);
+	return wvs_out && yuv_out;
+}
+
+static int run_synthetic(const struct bench_case *cases, size_t n_cases)
+{
+	const struct bench_resolution *res_max = &resolutions[N_RESOLUTIONS - 1];
+	if (!alloc_outputs(res_max->width, (uint64_t)res_max->width * res_max->height))
+		return 1;
+
+	for (size_t r = 0; r < N_RESOLUTIONS; r++) {
+		for (uint32_t p = 0; p < synthetic_patterns_count; p++) {
+			struct synthetic_frame frame;
+			if (!synthetic_frame_init(&frame, synthetic_patterns[p], resolutions[r].width,
+						  resolutions[r].height)) {
+				fprintf(stderr, "Error: failed to allocate frame\n");
+				synthetic_frame_free(&frame);
+				return 1;
+			}
+
+			const struct bench_input in = {
+				.pattern = frame.pattern,
+				.resolution = resolutions[r].name,
+				.frames = &frame,
+				.n_frames = 1,
+				.width = frame.sd.width,
+				.height = frame.sd.height,
+			};
+			for (size_t i = 0; i < n_cases; i++)
+				run_case(&cases[i], &in);
+
+			synthetic_frame_free(&frame);
+		}
+	}
+
+	return 0;
+}
+
+// Each iteration runs a case on all frames of the recording.
+static int run_replay(const struct bench_case *cases, size_t n_cases)
+{
+	struct cm_frame_reader *r = cm_frame_reader_open(opt.replay);
+	if (!r) {
+		fprintf(stderr, "Error: cannot open recording '%s'\n", opt.replay);
+		return 1;
+	}
+
+	const uint32_t n_frames = cm_frame_reader_count(r);
+	if (!n_frames) {
+		fprintf(stderr, "Error: no frame in '%s'\n", opt.replay);
+		cm_frame_reader_close(r);
+		return 1;
+	}
+
+	struct synthetic_frame *frames = calloc(n_frames, sizeof(struct synthetic_frame));
+	uint32_t max_width = 0;
+	uint64_t max_pixels = 0;
+	for (uint32_t i = 0; frames && i < n_frames; i++) {
+		frames[i].pattern = "replay";
+		cm_frame_reader_get(r, i, &frames[i].sd);
+		if (frames[i].sd.width > max_width)
+			max_width = frames[i].sd.width;
+		if ((uint64_t)frames[i].sd.width * frames[i].sd.height > max_pixels)
+			max_pixels = (uint64_t)frames[i].sd.width * frames[i].sd.height;
+	}
+	if (!frames || !alloc_outputs(max_width, max_pixels)) {
+		free(frames);
+		cm_frame_reader_close(r);
+		return 1;
+	}
+
+	char resolution[32];
+	snprintf(resolution, sizeof(resolution), "%ux%u", frames[0].sd.width, frames[0].sd.height);
+	if (opt.format == FORMAT_TEXT)
+		printf("# %u frames from '%s'\n", n_frames, opt.replay);
+
+	const struct bench_input in = {
+		.pattern = "replay",
+		.resolution = resolution,
+		.frames = frames,
+		.n_frames = n_frames,
+		.width = frames[0].sd.width,
+		.height = frames[0].sd.height,
+	};
+	for (size_t i = 0; i < n_cases; i++)
+		run_case(&cases[i], &in);
+
+	free(frames);
+	cm_frame_reader_close(r);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (!parse_args(argc, argv)) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	his_kernel_init();
+	if (opt.format == FORMAT_TEXT)
+		printf("# histogram kernel: %s\n", his_kernel_name());
+
+	size_t n_cases;
+	const struct bench_case *cases = build_cases(&n_cases);
+
+	int ret = opt.replay ? run_replay(cases, n_cases) : run_synthetic(cases, n_cases);
+
+	his_tiles_free(&tiles);
+	free(wvs_out);
+	free(yuv_out);
+	return ret;
+}
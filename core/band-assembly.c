@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint.h"
+#include "band-assembly.h"
+
+#define PLANE_RGB 1
+#define PLANE_Y 2
+#define PLANE_UV 4
+
+void cm_band_assembly_init(struct cm_band_assembly *a)
+{
+	memset(a, 0, sizeof(*a));
+}
+
+void cm_band_assembly_free(struct cm_band_assembly *a)
+{
+	free(a->buf);
+	cm_band_assembly_init(a);
+}
+
+static uint32_t band_planes(const struct cm_surface_data *band)
+{
+	return (band->rgb_data ? PLANE_RGB : 0) | (band->y_data ? PLANE_Y : 0) |
+	       (band->u_data && band->v_data ? PLANE_UV : 0);
+}
+
+static bool same_geometry(const struct cm_band_assembly *a, const struct cm_surface_data *band, uint32_t height,
+			  uint32_t n_bands)
+{
+	return a->buf && a->sd.width == band->width && a->sd.height == height && a->planes == band_planes(band) &&
+	       a->sd.uv_shift_x == band->uv_shift_x && a->sd.uv_shift_y == band->uv_shift_y && a->n_bands == n_bands;
+}
+
+static bool restart(struct cm_band_assembly *a, const struct cm_surface_data *band, uint32_t height,
+		    uint32_t n_bands)
+{
+	struct cm_surface_data sd = {
+		.width = band->width,
+		.height = height,
+		.uv_shift_x = band->uv_shift_x,
+		.uv_shift_y = band->uv_shift_y,
+	};
+	const uint32_t planes = band_planes(band);
+	const size_t rgb_size = planes & PLANE_RGB ? (size_t)sd.width * 4 * height : 0;
+	const size_t y_size = planes & PLANE_Y ? (size_t)sd.width * height : 0;
+	const size_t uv_size = planes & PLANE_UV ? (size_t)cm_surface_uv_width(&sd) * 2 * cm_surface_uv_height(&sd) : 0;
+	const size_t size = rgb_size + y_size + uv_size;
+
+	if (size != a->buf_size || !a->buf) {
+		free(a->buf);
+		a->buf = size ? calloc(1, size) : NULL;
+		a->buf_size = a->buf ? size : 0;
+	}
+	if (!a->buf)
+		return false;
+
+	if (planes & PLANE_RGB) {
+		sd.rgb_data = a->buf;
+		sd.linesize = sd.width * 4;
+	}
+	if (planes & PLANE_Y) {
+		sd.y_data = a->buf + rgb_size;
+		sd.y_linesize = sd.width;
+	}
+	if (planes & PLANE_UV) {
+		sd.u_data = a->buf + rgb_size + y_size;
+		sd.v_data = sd.u_data + 1;
+		sd.uv_linesize = cm_surface_uv_width(&sd) * 2;
+		sd.uv_step = 2;
+	}
+
+	a->sd = sd;
+	a->planes = planes;
+	a->n_bands = n_bands;
+	a->received = 0;
+	return true;
+}
+
+static void copy_rows(uint8_t *dst, uint32_t dst_linesize, const uint8_t *src, uint32_t src_linesize,
+		      uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++)
+		memcpy(dst + (size_t)dst_linesize * y, src + (size_t)src_linesize * y, row_bytes);
+}
+
+static void copy_uv(struct cm_band_assembly *a, const struct cm_surface_data *band, uint32_t uv_y0)
+{
+	const uint32_t uv_width = cm_surface_uv_width(band);
+	const uint32_t uv_height = cm_surface_uv_height(band);
+	uint8_t *dst = a->sd.u_data + (size_t)a->sd.uv_linesize * uv_y0;
+
+	if (band->v_data == band->u_data + 1 && band->uv_step == 2) {
+		copy_rows(dst, a->sd.uv_linesize, band->u_data, band->uv_linesize, uv_width * 2, uv_height);
+		return;
+	}
+
+	for (uint32_t y = 0; y < uv_height; y++) {
+		const uint8_t *u = band->u_data + (size_t)band->uv_linesize * y;
+		const uint8_t *v = band->v_data + (size_t)band->uv_linesize * y;
+		uint8_t *d = dst + (size_t)a->sd.uv_linesize * y;
+		for (uint32_t x = 0; x < uv_width; x++) {
+			d[x * 2] = u[x * band->uv_step];
+			d[x * 2 + 1] = v[x * band->uv_step];
+		}
+	}
+}
+
+bool cm_band_assembly_add(struct cm_band_assembly *a, const struct cm_surface_data *band, uint32_t y0,
+			  uint32_t height, uint32_t index, uint32_t n_bands)
+{
+	if (!n_bands || n_bands > CM_BAND_ASSEMBLY_MAX_BANDS || index >= n_bands)
+		return false;
+	if (y0 + band->height > height || y0 & ((1u << band->uv_shift_y) - 1))
+		return false;
+
+	if (!same_geometry(a, band, height, n_bands) && !restart(a, band, height, n_bands))
+		return false;
+
+	if (a->planes & PLANE_RGB) {
+		copy_rows(a->sd.rgb_data + (size_t)a->sd.linesize * y0, a->sd.linesize, band->rgb_data, band->linesize,
+			  band->width * 4, band->height);
+	}
+	if (a->planes & PLANE_Y) {
+		copy_rows(a->sd.y_data + (size_t)a->sd.y_linesize * y0, a->sd.y_linesize, band->y_data,
+			  band->y_linesize, band->width, band->height);
+	}
+	if (a->planes & PLANE_UV)
+		copy_uv(a, band, y0 >> band->uv_shift_y);
+
+	a->sd.colorspace = band->colorspace;
+	a->sd.timestamp = band->timestamp;
+
+	a->received |= 1u << index;
+	const uint32_t all = n_bands == 32 ? 0xFFFFFFFFu : (1u << n_bands) - 1;
+	if (a->received != all)
+		return false;
+
+	a->received = 0;
+	return true;
+}
+
+uint64_t cm_band_assembly_fingerprint(const struct cm_band_assembly *a, uint32_t row_step)
+{
+	const struct cm_surface_data *sd = &a->sd;
+	const uint32_t width = sd->width, height = sd->height;
+	uint64_t fp = 0;
+
+	if (a->planes & PLANE_RGB)
+		fp = cm_fingerprint_mix(fp, cm_fingerprint(sd->rgb_data, sd->linesize, width * 4, height, row_step));
+	if (a->planes & PLANE_Y)
+		fp = cm_fingerprint_mix(fp, cm_fingerprint(sd->y_data, sd->y_linesize, width, height, row_step));
+	if (a->planes & PLANE_UV) {
+		fp = cm_fingerprint_mix(fp, cm_fingerprint(sd->u_data, sd->uv_linesize, sd->uv_linesize,
+							   cm_surface_uv_height(sd), row_step));
+	}
+	return fp;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Assembly of a frame from horizontal bands read back over consecutive frames.
+ * Each band is copied into the buffer of the whole frame. When all the bands have been copied since
+ * the previous completion, the frame is complete and `sd` describes it; the bands can come from
+ * different frames of the source.
+ * The planes of the assembled frame are packed; RGB is BGRA, Y is one byte per pixel, and U and V are
+ * interleaved at the subsampling of the bands.
+ * This file does not depend on libobs.
+ */
+
+#define CM_BAND_ASSEMBLY_MAX_BANDS 32
+
+struct cm_band_assembly
+{
+	uint8_t *buf;
+	size_t buf_size;
+	struct cm_surface_data sd; // the assembled frame; the planes point into `buf`
+	uint32_t planes; // 1 for RGB, 2 for Y, 4 for UV
+	uint32_t n_bands;
+	uint32_t received; // bit mask of the bands copied since the previous completion
+};
+
+void cm_band_assembly_init(struct cm_band_assembly *a);
+void cm_band_assembly_free(struct cm_band_assembly *a);
+
+/*
+ * Copies `band`, which has the rows [y0, y0 + band->height) of the frame of `height` rows, as the band
+ * `index` of `n_bands`. `y0` has to be a multiple of `1 << band->uv_shift_y`.
+ * If the size, the planes, or the number of bands differ from the previous band, the assembly restarts.
+ * Returns true if the frame is complete.
+ */
+bool cm_band_assembly_add(struct cm_band_assembly *a, const struct cm_surface_data *band, uint32_t y0,
+			  uint32_t height, uint32_t index, uint32_t n_bands);
+
+// Fingerprint of the assembled frame, see fingerprint.h.
+uint64_t cm_band_assembly_fingerprint(const struct cm_band_assembly *a, uint32_t row_step);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,52 @@
+#include <string.h>
+#include "fingerprint.h"
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// Four independent lanes hide the latency of the multiplication.
+static uint64_t hash_row(uint64_t h, const uint8_t *p, uint32_t n)
+{
+	uint64_t a = h, b = h ^ PRIME1, c = h ^ PRIME2, d = ~h;
+
+	uint32_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		uint64_t w[4];
+		memcpy(w, p + i, sizeof(w));
+		a = rotl64(a, 27) + w[0] * PRIME2;
+		b = rotl64(b, 27) + w[1] * PRIME2;
+		c = rotl64(c, 27) + w[2] * PRIME2;
+		d = rotl64(d, 27) + w[3] * PRIME2;
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, sizeof(w));
+		a = rotl64(a, 27) + w * PRIME2;
+	}
+
+	h = rotl64(a, 1) + rotl64(b, 7) + rotl64(c, 12) + rotl64(d, 18);
+
+	for (; i < n; i++)
+		h = (h ^ p[i]) * PRIME1;
+
+	return cm_fingerprint_mix(h, n);
+}
+
+uint64_t cm_fingerprint(const uint8_t *data, uint32_t linesize, uint32_t row_bytes, uint32_t height,
+			uint32_t row_step)
+{
+	if (row_step < 1)
+		row_step = 1;
+
+	uint64_t h = cm_fingerprint_mix(0, height);
+	for (uint32_t y = 0; y < height; y += row_step)
+		h = hash_row(h, data + (size_t)linesize * y, row_bytes);
+
+	return h;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fingerprint of an image to detect a frame identical to the previous one.
+ * Only every `row_step`-th row is read so that the cost is a fraction of the analysis, which reads every row.
+ * A change that is only in the rows not read is not detected; the caller has to analyze the frame
+ * periodically regardless of the fingerprint.
+ * The bytes between `row_bytes` and `linesize` are not read.
+ * This file does not depend on libobs.
+ */
+
+uint64_t cm_fingerprint(const uint8_t *data, uint32_t linesize, uint32_t row_bytes, uint32_t height,
+			uint32_t row_step);
+
+// Combines a value such as the size of the image into a fingerprint.
+static inline uint64_t cm_fingerprint_mix(uint64_t h, uint64_t v)
+{
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	return h * 0xff51afd7ed558ccdULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "frame-record.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(_MSC_VER)
+#define cm_fseek _fseeki64
+#define cm_ftell _ftelli64
+#else
+#define cm_fseek fseeko
+#define cm_ftell ftello
+#endif
+
+#define ALIGN_UP(x) (((x) + (CM_FRAME_ALIGN - 1)) & ~(uint64_t)(CM_FRAME_ALIGN - 1))
+
+struct cm_frame_writer
+{
+	FILE *fp;
+	uint64_t offset;
+	uint64_t *index;
+	uint32_t n_frames, n_alloc;
+	uint8_t *line_buf;
+	size_t line_buf_size;
+};
+
+struct cm_frame_reader
+{
+	const uint8_t *data;
+	uint64_t size;
+	uint64_t *offsets;
+	uint32_t n_frames;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+};
+
+static bool write_padding(struct cm_frame_writer *w)
+{
+	static const uint8_t zero[CM_FRAME_ALIGN];
+	const uint64_t n = ALIGN_UP(w->offset) - w->offset;
+	if (n && fwrite(zero, 1, (size_t)n, w->fp) != n)
+		return false;
+	w->offset += n;
+	return true;
+}
+
+static bool write_data(struct cm_frame_writer *w, const void *data, size_t size)
+{
+	if (fwrite(data, 1, size, w->fp) != size)
+		return false;
+	w->offset += size;
+	return true;
+}
+
+struct cm_frame_writer *cm_frame_writer_open(const char *path)
+{
+	struct cm_frame_writer *w = calloc(1, sizeof(struct cm_frame_writer));
+	if (!w)
+		return NULL;
+
+	w->fp = fopen(path, "wb");
+	if (!w->fp) {
+		free(w);
+		return NULL;
+	}
+
+	struct cm_frame_file_header header = {.version = CM_FRAME_FILE_VERSION};
+	memcpy(header.magic, CM_FRAME_FILE_MAGIC, sizeof(header.magic));
+	if (!write_data(w, &header, sizeof(header)) || !write_padding(w)) {
+		fclose(w->fp);
+		free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+static bool write_plane(struct cm_frame_writer *w, const uint8_t *data, uint32_t linesize, uint32_t width_bytes,
+			uint32_t height)
+{
+	if (linesize == width_bytes)
+		return write_data(w, data, (size_t)width_bytes * height);
+
+	for (uint32_t y = 0; y < height; y++) {
+		if (!write_data(w, data + (size_t)linesize * y, width_bytes))
+			return false;
+	}
+	return true;
+}
+
+static uint64_t uv_plane_size(const struct cm_frame_record *rec)
+{
+	const uint64_t uv_width = (rec->width + (1u << rec->uv_shift_x) - 1) >> rec->uv_shift_x;
+	const uint64_t uv_height = (rec->height + (1u << rec->uv_shift_y) - 1) >> rec->uv_shift_y;
+	return uv_width * 2 * uv_height;
+}
+
+static bool write_uv_plane(struct cm_frame_writer *w, const struct cm_surface_data *sd)
+{
+	const uint32_t uv_width = cm_surface_uv_width(sd);
+	const uint32_t uv_height = cm_surface_uv_height(sd);
+	if (sd->uv_step == 2 && sd->v_data == sd->u_data + 1)
+		return write_plane(w, sd->u_data, sd->uv_linesize, uv_width * 2, uv_height);
+
+	const size_t size = (size_t)uv_width * 2;
+	if (w->line_buf_size < size) {
+		free(w->line_buf);
+		w->line_buf = malloc(size);
+		w->line_buf_size = w->line_buf ? size : 0;
+		if (!w->line_buf)
+			return false;
+	}
+
+	for (uint32_t y = 0; y < uv_height; y++) {
+		const uint8_t *u = sd->u_data + (size_t)sd->uv_linesize * y;
+		const uint8_t *v = sd->v_data + (size_t)sd->uv_linesize * y;
+		for (uint32_t x = 0; x < uv_width; x++) {
+			w->line_buf[x * 2] = u[x * sd->uv_step];
+			w->line_buf[x * 2 + 1] = v[x * sd->uv_step];
+		}
+		if (!write_data(w, w->line_buf, size))
+			return false;
+	}
+	return true;
+}
+
+bool cm_frame_writer_write(struct cm_frame_writer *w, const struct cm_surface_data *sd)
+{
+	struct cm_frame_record rec = {
+		.magic = CM_FRAME_RECORD_MAGIC,
+		.width = sd->width,
+		.height = sd->height,
+		.colorspace = sd->colorspace,
+		.timestamp = sd->timestamp,
+	};
+	if (sd->rgb_data) {
+		rec.flags |= CM_FRAME_HAS_RGB;
+		rec.linesize = sd->width * 4;
+	}
+	if (sd->y_data) {
+		rec.flags |= CM_FRAME_HAS_Y;
+		rec.y_linesize = sd->width;
+	}
+	if (sd->u_data && sd->v_data) {
+		rec.flags |= CM_FRAME_HAS_UV;
+		rec.uv_linesize = cm_surface_uv_width(sd) * 2;
+		rec.uv_shift_x = (uint8_t)sd->uv_shift_x;
+		rec.uv_shift_y = (uint8_t)sd->uv_shift_y;
+	}
+
+	const uint64_t n_pixels = (uint64_t)sd->width * sd->height;
+	rec.size = ALIGN_UP(sizeof(rec));
+	if (rec.flags & CM_FRAME_HAS_RGB)
+		rec.size += ALIGN_UP(n_pixels * 4);
+	if (rec.flags & CM_FRAME_HAS_Y)
+		rec.size += ALIGN_UP(n_pixels);
+	if (rec.flags & CM_FRAME_HAS_UV)
+		rec.size += ALIGN_UP(uv_plane_size(&rec));
+
+	if (w->n_frames >= w->n_alloc) {
+		uint32_t n_alloc = w->n_alloc ? w->n_alloc * 2 : 256;
+		uint64_t *index = realloc(w->index, sizeof(uint64_t) * n_alloc);
+		if (!index)
+			return false;
+		w->index = index;
+		w->n_alloc = n_alloc;
+	}
+	const uint64_t offset = w->offset;
+
+	if (!write_data(w, &rec, sizeof(rec)) || !write_padding(w))
+		return false;
+	if (rec.flags & CM_FRAME_HAS_RGB) {
+		if (!write_plane(w, sd->rgb_data, sd->linesize, sd->width * 4, sd->height) || !write_padding(w))
+			return false;
+	}
+	if (rec.flags & CM_FRAME_HAS_Y) {
+		if (!write_plane(w, sd->y_data, sd->y_linesize, sd->width, sd->height) || !write_padding(w))
+			return false;
+	}
+	if (rec.flags & CM_FRAME_HAS_UV) {
+		if (!write_uv_plane(w, sd) || !write_padding(w))
+			return false;
+	}
+
+	w->index[w->n_frames++] = offset;
+	return true;
+}
+
+void cm_frame_writer_close(struct cm_frame_writer *w)
+{
+	if (!w)
+		return;
+
+	struct cm_frame_file_header header = {
+		.version = CM_FRAME_FILE_VERSION,
+		.n_frames = w->n_frames,
+		.index_offset = w->offset,
+	};
+	memcpy(header.magic, CM_FRAME_FILE_MAGIC, sizeof(header.magic));
+
+	if (w->n_frames && write_data(w, w->index, sizeof(uint64_t) * w->n_frames)) {
+		if (cm_fseek(w->fp, 0, SEEK_SET) == 0)
+			fwrite(&header, 1, sizeof(header), w->fp);
+	}
+
+	fclose(w->fp);
+	free(w->index);
+	free(w->line_buf);
+	free(w);
+}
+
+static bool map_file(struct cm_frame_reader *r, const char *path)
+{
+#ifdef _WIN32
+	r->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (r->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(r->file, &size) || size.QuadPart == 0)
+		return false;
+	r->size = (uint64_t)size.QuadPart;
+
+	r->mapping = CreateFileMappingA(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!r->mapping)
+		return false;
+
+	r->data = MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+	return r->data != NULL;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	r->size = (uint64_t)st.st_size;
+
+	void *data = mmap(NULL, (size_t)r->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	r->data = data;
+	return true;
+#endif
+}
+
+static void unmap_file(struct cm_frame_reader *r)
+{
+#ifdef _WIN32
+	if (r->data)
+		UnmapViewOfFile(r->data);
+	if (r->mapping)
+		CloseHandle(r->mapping);
+	if (r->file && r->file != INVALID_HANDLE_VALUE)
+		CloseHandle(r->file);
+#else
+	if (r->data)
+		munmap((void *)r->data, (size_t)r->size);
+#endif
+}
+
+static const struct cm_frame_record *record_at(const struct cm_frame_reader *r, uint64_t offset)
+{
+	if (offset % CM_FRAME_ALIGN || offset > r->size || r->size - offset < sizeof(struct cm_frame_record))
+		return NULL;
+
+	const struct cm_frame_record *rec = (const struct cm_frame_record *)(r->data + offset);
+	if (rec->magic != CM_FRAME_RECORD_MAGIC || rec->size > r->size - offset)
+		return NULL;
+
+	// The planes are stored without padding; any other linesize would make the kernels read past the plane.
+	const uint64_t n_pixels = (uint64_t)rec->width * rec->height;
+	uint64_t size = ALIGN_UP(sizeof(*rec));
+	if (rec->flags & CM_FRAME_HAS_RGB) {
+		if ((uint64_t)rec->linesize != (uint64_t)rec->width * 4)
+			return NULL;
+		size += ALIGN_UP(n_pixels * 4);
+	}
+	if (rec->flags & CM_FRAME_HAS_Y) {
+		if (rec->y_linesize != rec->width)
+			return NULL;
+		size += ALIGN_UP(n_pixels);
+	}
+	if (rec->flags & CM_FRAME_HAS_UV) {
+		if (rec->uv_shift_x > 1 || rec->uv_shift_y > 1)
+			return NULL;
+		const uint64_t uv_width = (rec->width + (1u << rec->uv_shift_x) - 1) >> rec->uv_shift_x;
+		if ((uint64_t)rec->uv_linesize != uv_width * 2)
+			return NULL;
+		size += ALIGN_UP(uv_plane_size(rec));
+	}
+	if (size != rec->size)
+		return NULL;
+
+	return rec;
+}
+
+static bool load_index(struct cm_frame_reader *r, const struct cm_frame_file_header *header)
+{
+	if (!header->n_frames || header->index_offset > r->size ||
+	    (r->size - header->index_offset) / sizeof(uint64_t) < header->n_frames)
+		return false;
+
+	r->offsets = malloc(sizeof(uint64_t) * header->n_frames);
+	if (!r->offsets)
+		return false;
+	memcpy(r->offsets, r->data + header->index_offset, sizeof(uint64_t) * header->n_frames);
+	r->n_frames = header->n_frames;
+
+	for (uint32_t i = 0; i < r->n_frames; i++) {
+		if (!record_at(r, r->offsets[i]))
+			return false;
+	}
+	return true;
+}
+
+// Used if the writer was not closed. A truncated frame at the end is ignored.
+static bool scan_frames(struct cm_frame_reader *r)
+{
+	uint32_t n_alloc = 0;
+	uint64_t offset = ALIGN_UP(sizeof(struct cm_frame_file_header));
+	const struct cm_frame_record *rec;
+
+	free(r->offsets);
+	r->offsets = NULL;
+	r->n_frames = 0;
+
+	while ((rec = record_at(r, offset))) {
+		if (r->n_frames >= n_alloc) {
+			n_alloc = n_alloc ? n_alloc * 2 : 256;
+			uint64_t *offsets = realloc(r->offsets, sizeof(uint64_t) * n_alloc);
+			if (!offsets)
+				return false;
+			r->offsets = offsets;
+		}
+		r->offsets[r->n_frames++] = offset;
+		offset += rec->size;
+	}
+
+	return true;
+}
+
+struct cm_frame_reader *cm_frame_reader_open(const char *path)
+{
+	struct cm_frame_reader *r = calloc(1, sizeof(struct cm_frame_reader));
+	if (!r)
+		return NULL;
+
+	if (!map_file(r, path) || r->size < sizeof(struct cm_frame_file_header)) {
+		cm_frame_reader_close(r);
+		return NULL;
+	}
+
+	const struct cm_frame_file_header *header = (const struct cm_frame_file_header *)r->data;
+	if (memcmp(header->magic, CM_FRAME_FILE_MAGIC, sizeof(header->magic)) ||
+	    header->version < 1 || header->version > CM_FRAME_FILE_VERSION) {
+		cm_frame_reader_close(r);
+		return NULL;
+	}
+
+	if (!load_index(r, header) && !scan_frames(r)) {
+		cm_frame_reader_close(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+void cm_frame_reader_close(struct cm_frame_reader *r)
+{
+	if (!r)
+		return;
+
+	unmap_file(r);
+	free(r->offsets);
+	free(r);
+}
+
+uint32_t cm_frame_reader_count(const struct cm_frame_reader *r)
+{
+	return r->n_frames;
+}
+
+bool cm_frame_reader_get(const struct cm_frame_reader *r, uint32_t index, struct cm_surface_data *sd)
+{
+	if (index >= r->n_frames)
+		return false;
+
+	const struct cm_frame_record *rec = record_at(r, r->offsets[index]);
+	if (!rec)
+		return false;
+
+	const uint64_t n_pixels = (uint64_t)rec->width * rec->height;
+	uint8_t *p = (uint8_t *)rec + ALIGN_UP(sizeof(*rec));
+
+	memset(sd, 0, sizeof(*sd));
+	sd->width = rec->width;
+	sd->height = rec->height;
+	sd->colorspace = rec->colorspace;
+	sd->timestamp = rec->timestamp;
+	if (rec->flags & CM_FRAME_HAS_RGB) {
+		sd->rgb_data = p;
+		sd->linesize = rec->linesize;
+		p += ALIGN_UP(n_pixels * 4);
+	}
+	if (rec->flags & CM_FRAME_HAS_Y) {
+		sd->y_data = p;
+		sd->y_linesize = rec->y_linesize;
+		p += ALIGN_UP(n_pixels);
+	}
+	if (rec->flags & CM_FRAME_HAS_UV) {
+		sd->u_data = p;
+		sd->v_data = p + 1;
+		sd->uv_linesize = rec->uv_linesize;
+		sd->uv_step = 2;
+		sd->uv_shift_x = rec->uv_shift_x;
+		sd->uv_shift_y = rec->uv_shift_y;
+	}
+	return true;
+}
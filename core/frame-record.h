@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Recording of the frames given to the scopes, to replay them without OBS Studio.
+ *
+ * The file starts with `struct cm_frame_file_header`, followed by the frames.
+ * Each frame is `struct cm_frame_record` followed by the RGB, Y, and UV planes, which are present if
+ * the corresponding flag is set. The planes are stored without padding at the end of the lines;
+ * RGB is BGRA, Y is one byte per pixel, and UV is interleaved U and V, which is subsampled by
+ * `uv_shift_x` and `uv_shift_y` as `struct cm_surface_data`.
+ * The header and every plane start at a multiple of CM_FRAME_ALIGN bytes so that the kernels can
+ * read the planes directly from the mapped file.
+ * When the writer is closed, the offsets of the frames are appended as the index and the header is
+ * updated. If the index is missing, eg. OBS Studio crashed while recording, the reader scans the frames.
+ * All values are little endian.
+ * This file does not depend on libobs.
+ */
+
+#define CM_FRAME_FILE_MAGIC "CMFRAMES"
+#define CM_FRAME_FILE_VERSION 2 // 2 added the subsampled UV; the reader accepts 1 too
+#define CM_FRAME_RECORD_MAGIC 0x52464d43 // "CMFR"
+#define CM_FRAME_ALIGN 64
+
+#define CM_FRAME_HAS_RGB 1
+#define CM_FRAME_HAS_Y 2
+#define CM_FRAME_HAS_UV 4
+
+struct cm_frame_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t n_frames; // 0 if the index is not written
+	uint64_t index_offset; // array of `n_frames` uint64_t offsets of the frames
+	uint8_t reserved[40];
+};
+
+struct cm_frame_record
+{
+	uint32_t magic;
+	uint32_t flags; // CM_FRAME_HAS_*
+	uint32_t width, height;
+	int32_t colorspace;
+	uint32_t linesize, y_linesize, uv_linesize; // as stored in the file
+	uint64_t timestamp; // ns
+	uint64_t size; // including this header and the planes
+	uint8_t uv_shift_x, uv_shift_y; // 0 in the version 1
+	uint8_t reserved[14];
+};
+
+struct cm_frame_writer;
+struct cm_frame_reader;
+
+struct cm_frame_writer *cm_frame_writer_open(const char *path);
+
+// Appends the planes that are not NULL in `surface_data`. Returns false on error.
+bool cm_frame_writer_write(struct cm_frame_writer *w, const struct cm_surface_data *surface_data);
+
+// Writes the index and closes the file.
+void cm_frame_writer_close(struct cm_frame_writer *w);
+
+// Maps the whole file. Returns NULL if the file is not a valid recording.
+struct cm_frame_reader *cm_frame_reader_open(const char *path);
+void cm_frame_reader_close(struct cm_frame_reader *r);
+
+uint32_t cm_frame_reader_count(const struct cm_frame_reader *r);
+
+/*
+ * Sets up `surface_data` to point the planes of the frame `index` in the mapped file.
+ * The pointers are valid until the reader is closed. The data must not be modified.
+ */
+bool cm_frame_reader_get(const struct cm_frame_reader *r, uint32_t index, struct cm_surface_data *surface_data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,460 @@
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "histogram-kernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HIS_KERNEL_SSE2
+#define HIS_KERNEL_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define HIS_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+/*
+ * Each channel has N_BANKS sub-histograms and consecutive pixels go to different banks.
+ * Flat content would otherwise increment the same counter back to back and stall on
+ * store-to-load forwarding.
+ */
+#define N_BANKS 4
+
+struct his_banks
+{
+	uint32_t c[3][N_BANKS][256 + 16];
+};
+
+void his_kernel_scalar(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height, uint32_t linesize,
+		       uint32_t channels)
+{
+	const bool calc_0 = !!(channels & HIS_KERNEL_CH0);
+	const bool calc_1 = !!(channels & HIS_KERNEL_CH1);
+	const bool calc_2 = !!(channels & HIS_KERNEL_CH2);
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *v = video_data + linesize * y;
+		for (uint32_t x = 0; x < width; x++) {
+			const uint8_t b = *v++;
+			const uint8_t g = *v++;
+			const uint8_t r = *v++;
+			const uint8_t a = *v++;
+			if (!a)
+				continue;
+			if (calc_0)
+				dbuf[r * 4 + 0]++;
+			if (calc_1)
+				dbuf[g * 4 + 1]++;
+			if (calc_2)
+				dbuf[b * 4 + 2]++;
+		}
+	}
+}
+
+static inline uint32_t load_pixel(const uint8_t *p)
+{
+	// Assumes little endian; byte 0 comes to the lowest bits.
+	uint32_t px;
+	memcpy(&px, p, sizeof(px));
+	return px;
+}
+
+// `w` is 1 for opaque pixels and 0 for pixels to be skipped.
+static inline void banks_add(struct his_banks *bk, int bank, uint32_t px, uint32_t w, bool calc_0, bool calc_1,
+			     bool calc_2)
+{
+	if (calc_0)
+		bk->c[0][bank][px >> 16 & 0xFF] += w;
+	if (calc_1)
+		bk->c[1][bank][px >> 8 & 0xFF] += w;
+	if (calc_2)
+		bk->c[2][bank][px & 0xFF] += w;
+}
+
+static inline uint32_t alpha_weight(uint32_t px)
+{
+	return (px >> 24) != 0;
+}
+
+static inline void banks_add_tail(struct his_banks *bk, const uint8_t *p, uint32_t n, bool calc_0, bool calc_1,
+				  bool calc_2)
+{
+	for (uint32_t i = 0; i < n; i++, p += 4) {
+		const uint32_t px = load_pixel(p);
+		banks_add(bk, i % N_BANKS, px, alpha_weight(px), calc_0, calc_1, calc_2);
+	}
+}
+
+static void banks_merge(uint32_t *dbuf, const struct his_banks *bk, uint32_t channels)
+{
+	for (int c = 0; c < 3; c++) {
+		if (!(channels & (1 << c)))
+			continue;
+		for (int i = 0; i < 256; i++) {
+			uint32_t sum = 0;
+			for (int k = 0; k < N_BANKS; k++)
+				sum += bk->c[c][k][i];
+			dbuf[i * 4 + c] += sum;
+		}
+	}
+}
+
+void his_kernel_banked(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height, uint32_t linesize,
+		       uint32_t channels)
+{
+	const bool calc_0 = !!(channels & HIS_KERNEL_CH0);
+	const bool calc_1 = !!(channels & HIS_KERNEL_CH1);
+	const bool calc_2 = !!(channels & HIS_KERNEL_CH2);
+
+	struct his_banks bk;
+	memset(&bk, 0, sizeof(bk));
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *p = video_data + linesize * y;
+		uint32_t x = 0;
+		for (; x + N_BANKS <= width; x += N_BANKS, p += N_BANKS * 4) {
+			uint32_t px[N_BANKS];
+			bool opaque = true;
+			for (int k = 0; k < N_BANKS; k++) {
+				px[k] = load_pixel(p + k * 4);
+				opaque = opaque && alpha_weight(px[k]);
+			}
+			if (opaque) {
+				for (int k = 0; k < N_BANKS; k++)
+					banks_add(&bk, k, px[k], 1, calc_0, calc_1, calc_2);
+			} else {
+				for (int k = 0; k < N_BANKS; k++)
+					banks_add(&bk, k, px[k], alpha_weight(px[k]), calc_0, calc_1, calc_2);
+			}
+		}
+		banks_add_tail(&bk, p, width - x, calc_0, calc_1, calc_2);
+	}
+
+	banks_merge(dbuf, &bk, channels);
+}
+
+void his_kernel_plane(uint32_t *dbuf, const uint8_t *data, uint32_t width, uint32_t height, uint32_t linesize,
+		      uint32_t step, uint32_t channel)
+{
+	uint32_t bk[N_BANKS][256 + 16] = {{0}};
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *v = data + linesize * y;
+		uint32_t x = 0;
+		for (; x + N_BANKS <= width; x += N_BANKS, v += step * N_BANKS) {
+			bk[0][v[0]]++;
+			bk[1][v[step]]++;
+			bk[2][v[step * 2]]++;
+			bk[3][v[step * 3]]++;
+		}
+		for (; x < width; x++, v += step)
+			bk[0][*v]++;
+	}
+
+	for (int i = 0; i < 256; i++)
+		dbuf[i * 4 + channel] += bk[0][i] + bk[1][i] + bk[2][i] + bk[3][i];
+}
+
+/*
+ * Accumulates the chroma rows of the luma rows [y0, y1).
+ * A subsampled chroma sample is counted as many times as the luma samples it covers so that the chroma
+ * has the same scale as the luma.
+ */
+static void accumulate_chroma(uint32_t *dbuf, const struct cm_surface_data *sd, const uint8_t *data,
+			      uint32_t channel, uint32_t y0, uint32_t y1)
+{
+	const uint32_t shift = sd->uv_shift_x + sd->uv_shift_y;
+	const uint32_t uy0 = cm_surface_uv_row(sd, y0);
+	const uint32_t uy1 = cm_surface_uv_row(sd, y1);
+	const uint32_t uv_width = cm_surface_uv_width(sd);
+	data += (size_t)sd->uv_linesize * uy0;
+
+	if (!shift) {
+		his_kernel_plane(dbuf, data, uv_width, uy1 - uy0, sd->uv_linesize, sd->uv_step, channel);
+		return;
+	}
+
+	uint32_t tmp[256 * 4];
+	memset(tmp, 0, sizeof(tmp));
+	his_kernel_plane(tmp, data, uv_width, uy1 - uy0, sd->uv_linesize, sd->uv_step, channel);
+	for (int i = 0; i < 256; i++)
+		dbuf[i * 4 + channel] += tmp[i * 4 + channel] << shift;
+}
+
+void his_kernel_accumulate(uint32_t *dbuf, const struct cm_surface_data *surface_data, uint32_t components,
+			   uint32_t y0, uint32_t y1)
+{
+	const uint32_t width = surface_data->width;
+
+	if (components & 0x07) {
+		const uint32_t channels = (components & 0x04 ? HIS_KERNEL_CH0 : 0) |
+					  (components & 0x02 ? HIS_KERNEL_CH1 : 0) |
+					  (components & 0x01 ? HIS_KERNEL_CH2 : 0);
+		const uint32_t linesize = surface_data->linesize;
+		his_kernel(dbuf, surface_data->rgb_data + linesize * y0, width, y1 - y0, linesize, channels);
+		return;
+	}
+
+	const uint32_t y_linesize = surface_data->y_linesize;
+	if (components & 0x20)
+		his_kernel_plane(dbuf, surface_data->y_data + y_linesize * y0, width, y1 - y0, y_linesize, 1, 1);
+	if (components & 0x40)
+		accumulate_chroma(dbuf, surface_data, surface_data->v_data, 0, y0, y1);
+	if (components & 0x10)
+		accumulate_chroma(dbuf, surface_data, surface_data->u_data, 2, y0, y1);
+}
+
+void his_kernel_calculate_max(uint32_t *hi_max, const uint32_t *dbuf, uint32_t components)
+{
+	const bool calc_b = (components & 0x11) ? true : false;
+	const bool calc_g = (components & 0x22) ? true : false;
+	const bool calc_r = (components & 0x44) ? true : false;
+
+	hi_max[0] = 1;
+	hi_max[1] = 1;
+	hi_max[2] = 1;
+	for (int i = 0; i < 256; i++) {
+		if (calc_r && dbuf[i * 4 + 0] > hi_max[0])
+			hi_max[0] = dbuf[i * 4 + 0];
+		if (calc_g && dbuf[i * 4 + 1] > hi_max[1])
+			hi_max[1] = dbuf[i * 4 + 1];
+		if (calc_b && dbuf[i * 4 + 2] > hi_max[2])
+			hi_max[2] = dbuf[i * 4 + 2];
+	}
+}
+
+void his_kernel_fix_max(uint32_t *hi_max, uint32_t level)
+{
+	uint32_t v = level == 0 ? 1 : level;
+	hi_max[0] = v;
+	hi_max[1] = v;
+	hi_max[2] = v;
+}
+
+void his_kernel_to_float(float *flt, const uint32_t *dbuf, uint32_t *hi_max, uint32_t components, bool logscale)
+{
+	if (logscale) {
+		for (int j = 0, mask = 0x44; j < 3; j++, mask >>= 1) {
+			if (!(components & mask))
+				continue;
+			const float s = 1.0f / logf((float)(hi_max[j] + 1));
+			for (int i = 0; i < 256; i++)
+				flt[i * 4 + j] = dbuf[i * 4 + j] ? logf((float)(dbuf[i * 4 + j] + 1)) * s : 0;
+			hi_max[j] = 1;
+		}
+	} else {
+		for (int i = 0; i < 256 * 4; i++)
+			flt[i] = (float)dbuf[i];
+	}
+}
+
+#ifdef HIS_KERNEL_SSE2
+static inline void banks_add_m128(struct his_banks *bk, __m128i v, uint32_t w, bool calc_0, bool calc_1, bool calc_2)
+{
+	banks_add(bk, 0, (uint32_t)_mm_cvtsi128_si32(v), w, calc_0, calc_1, calc_2);
+	banks_add(bk, 1, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 4)), w, calc_0, calc_1, calc_2);
+	banks_add(bk, 2, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8)), w, calc_0, calc_1, calc_2);
+	banks_add(bk, 3, (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 12)), w, calc_0, calc_1, calc_2);
+}
+
+static inline void banks_add_m128_masked(struct his_banks *bk, __m128i v, bool calc_0, bool calc_1, bool calc_2)
+{
+	uint32_t px[4];
+	_mm_storeu_si128((__m128i *)px, v);
+	for (int k = 0; k < 4; k++)
+		banks_add(bk, k, px[k], alpha_weight(px[k]), calc_0, calc_1, calc_2);
+}
+
+static void his_kernel_sse2(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height,
+			    uint32_t linesize, uint32_t channels)
+{
+	const bool calc_0 = !!(channels & HIS_KERNEL_CH0);
+	const bool calc_1 = !!(channels & HIS_KERNEL_CH1);
+	const bool calc_2 = !!(channels & HIS_KERNEL_CH2);
+	const __m128i zero = _mm_setzero_si128();
+
+	struct his_banks bk;
+	memset(&bk, 0, sizeof(bk));
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *p = video_data + linesize * y;
+		uint32_t x = 0;
+		for (; x + 4 <= width; x += 4, p += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i *)p);
+			const int transparent = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0x8888;
+			if (!transparent)
+				banks_add_m128(&bk, v, 1, calc_0, calc_1, calc_2);
+			else if (transparent != 0x8888)
+				banks_add_m128_masked(&bk, v, calc_0, calc_1, calc_2);
+		}
+		banks_add_tail(&bk, p, width - x, calc_0, calc_1, calc_2);
+	}
+
+	banks_merge(dbuf, &bk, channels);
+}
+#endif // HIS_KERNEL_SSE2
+
+#ifdef HIS_KERNEL_AVX2
+TARGET_AVX2 static void his_kernel_avx2(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height,
+					uint32_t linesize, uint32_t channels)
+{
+	const bool calc_0 = !!(channels & HIS_KERNEL_CH0);
+	const bool calc_1 = !!(channels & HIS_KERNEL_CH1);
+	const bool calc_2 = !!(channels & HIS_KERNEL_CH2);
+	const __m256i zero = _mm256_setzero_si256();
+
+	struct his_banks bk;
+	memset(&bk, 0, sizeof(bk));
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *p = video_data + linesize * y;
+		uint32_t x = 0;
+		for (; x + 8 <= width; x += 8, p += 32) {
+			const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+			const uint32_t transparent =
+				(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) & 0x88888888u;
+			if (transparent == 0x88888888u)
+				continue;
+
+			const __m128i lo = _mm256_castsi256_si128(v);
+			const __m128i hi = _mm256_extracti128_si256(v, 1);
+			if (!transparent) {
+				banks_add_m128(&bk, lo, 1, calc_0, calc_1, calc_2);
+				banks_add_m128(&bk, hi, 1, calc_0, calc_1, calc_2);
+			} else {
+				banks_add_m128_masked(&bk, lo, calc_0, calc_1, calc_2);
+				banks_add_m128_masked(&bk, hi, calc_0, calc_1, calc_2);
+			}
+		}
+		banks_add_tail(&bk, p, width - x, calc_0, calc_1, calc_2);
+	}
+
+	banks_merge(dbuf, &bk, channels);
+}
+#endif // HIS_KERNEL_AVX2
+
+#ifdef HIS_KERNEL_NEON
+static void his_kernel_neon(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height,
+			    uint32_t linesize, uint32_t channels)
+{
+	const bool calc_0 = !!(channels & HIS_KERNEL_CH0);
+	const bool calc_1 = !!(channels & HIS_KERNEL_CH1);
+	const bool calc_2 = !!(channels & HIS_KERNEL_CH2);
+
+	struct his_banks bk;
+	memset(&bk, 0, sizeof(bk));
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *p = video_data + linesize * y;
+		uint32_t x = 0;
+		for (; x + 16 <= width; x += 16, p += 64) {
+			const uint8x16x4_t v = vld4q_u8(p);
+			if (vmaxvq_u8(v.val[3]) == 0)
+				continue;
+
+			uint8_t c[4][16];
+			vst1q_u8(c[0], v.val[0]);
+			vst1q_u8(c[1], v.val[1]);
+			vst1q_u8(c[2], v.val[2]);
+			vst1q_u8(c[3], v.val[3]);
+
+			const bool opaque = vminvq_u8(v.val[3]) != 0;
+			for (int i = 0; i < 16; i++) {
+				const uint32_t w = opaque ? 1 : c[3][i] != 0;
+				const int k = i % N_BANKS;
+				if (calc_0)
+					bk.c[0][k][c[2][i]] += w;
+				if (calc_1)
+					bk.c[1][k][c[1][i]] += w;
+				if (calc_2)
+					bk.c[2][k][c[0][i]] += w;
+			}
+		}
+		banks_add_tail(&bk, p, width - x, calc_0, calc_1, calc_2);
+	}
+
+	banks_merge(dbuf, &bk, channels);
+}
+#endif // HIS_KERNEL_NEON
+
+#ifdef HIS_KERNEL_AVX2
+static bool cpu_has_avx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = !!(info[2] & (1 << 27));
+	const bool avx = !!(info[2] & (1 << 28));
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return !!(info[1] & (1 << 5));
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return !!__builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+#endif // HIS_KERNEL_AVX2
+
+his_kernel_func_t his_kernel = his_kernel_banked;
+static const char *kernel_name = "banked";
+
+void his_kernel_init(void)
+{
+#ifdef HIS_KERNEL_SSE2
+	his_kernel = his_kernel_sse2;
+	kernel_name = "sse2";
+#endif
+#ifdef HIS_KERNEL_AVX2
+	if (cpu_has_avx2()) {
+		his_kernel = his_kernel_avx2;
+		kernel_name = "avx2";
+	}
+#endif
+#ifdef HIS_KERNEL_NEON
+	his_kernel = his_kernel_neon;
+	kernel_name = "neon";
+#endif
+}
+
+const char *his_kernel_name(void)
+{
+	return kernel_name;
+}
+
+const struct his_kernel_variant *his_kernel_variants(size_t *n)
+{
+	static struct his_kernel_variant variants[8];
+	size_t i = 0;
+
+	variants[i++] = (struct his_kernel_variant){"scalar", his_kernel_scalar};
+	variants[i++] = (struct his_kernel_variant){"banked", his_kernel_banked};
+#ifdef HIS_KERNEL_SSE2
+	variants[i++] = (struct his_kernel_variant){"sse2", his_kernel_sse2};
+#endif
+#ifdef HIS_KERNEL_AVX2
+	if (cpu_has_avx2())
+		variants[i++] = (struct his_kernel_variant){"avx2", his_kernel_avx2};
+#endif
+#ifdef HIS_KERNEL_NEON
+	variants[i++] = (struct his_kernel_variant){"neon", his_kernel_neon};
+#endif
+
+	*n = i;
+	return variants;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Histogram accumulation kernels.
+ * The input is BGRA packed pixels. Pixels having zero alpha are skipped.
+ * Counts are added to `dbuf`, which has the layout `dbuf[value * 4 + channel]`;
+ * channel 0 takes byte 2 (R or V), 1 takes byte 1 (G or Y), and 2 takes byte 0 (B or U).
+ * This file does not depend on libobs.
+ */
+
+#define HIS_KERNEL_CH0 1
+#define HIS_KERNEL_CH1 2
+#define HIS_KERNEL_CH2 4
+
+typedef void (*his_kernel_func_t)(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height,
+				  uint32_t linesize, uint32_t channels);
+
+// Straightforward loop kept as the reference of the other kernels.
+void his_kernel_scalar(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height, uint32_t linesize,
+		       uint32_t channels);
+
+// Portable C kernel with several sub-histograms for each channel.
+void his_kernel_banked(uint32_t *dbuf, const uint8_t *video_data, uint32_t width, uint32_t height, uint32_t linesize,
+		       uint32_t channels);
+
+/*
+ * Accumulates one 8-bit plane such as Y, U, or V into `dbuf[value * 4 + channel]`.
+ * Samples are `step` bytes apart in a line. No sample is skipped.
+ */
+void his_kernel_plane(uint32_t *dbuf, const uint8_t *data, uint32_t width, uint32_t height, uint32_t linesize,
+		      uint32_t step, uint32_t channel);
+
+/*
+ * Accumulates the rows [y0, y1) of the frame into `dbuf`.
+ * `components` has the same bits as the property of the histogram source;
+ * 0x04, 0x02, and 0x01 for R, G, and B from `rgb_data`, or
+ * 0x40, 0x20, and 0x10 for V, Y, and U from the planes.
+ * If any of RGB is set, the planes are not used.
+ * Subsampled U and V are weighted by the number of the luma samples covered by each chroma sample.
+ */
+void his_kernel_accumulate(uint32_t *dbuf, const struct cm_surface_data *surface_data, uint32_t components,
+			   uint32_t y0, uint32_t y1);
+
+/*
+ * Normalization of the accumulated `dbuf`.
+ * `hi_max` has 3 elements and receives the level of the top of the graph for each channel.
+ */
+
+// Takes the largest count of the channels selected by `components`. The others are set to 1.
+void his_kernel_calculate_max(uint32_t *hi_max, const uint32_t *dbuf, uint32_t components);
+
+// Sets the same level to all channels. Zero is replaced by 1.
+void his_kernel_fix_max(uint32_t *hi_max, uint32_t level);
+
+/*
+ * Converts the counts to float for the texture.
+ * If `logscale` is set, the counts of the channels selected by `components` are scaled
+ * by `log(count + 1) / log(hi_max + 1)` and their `hi_max` is set to 1.
+ * `flt` can be the same buffer as `dbuf`.
+ */
+void his_kernel_to_float(float *flt, const uint32_t *dbuf, uint32_t *hi_max, uint32_t components, bool logscale);
+
+/* Select the best kernel for the running CPU. Call once before `his_kernel`. */
+void his_kernel_init(void);
+const char *his_kernel_name(void);
+
+struct his_kernel_variant
+{
+	const char *name;
+	his_kernel_func_t func;
+};
+
+// Lists the kernels that can run on this CPU, starting with "scalar", to compare them in tests.
+const struct his_kernel_variant *his_kernel_variants(size_t *n);
+
+extern his_kernel_func_t his_kernel;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include "histogram-kernel.h"
+#include "fingerprint.h"
+#include "histogram-tiles.h"
+
+void his_tiles_init(struct his_tiles *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+void his_tiles_free(struct his_tiles *t)
+{
+	free(t->hash);
+	free(t->valid);
+	free(t->counts);
+	his_tiles_init(t);
+}
+
+void his_tiles_invalidate(struct his_tiles *t)
+{
+	// Keep the histograms of the tiles so that their contribution to the total is subtracted.
+	if (t->valid)
+		memset(t->valid, 0, sizeof(bool) * t->n_x * t->n_y);
+}
+
+uint32_t his_tiles_begin(struct his_tiles *t, const struct cm_surface_data *surface_data, uint32_t components)
+{
+	const uint32_t uv_shift = surface_data->uv_shift_x | surface_data->uv_shift_y << 8;
+	if (t->counts && t->width == surface_data->width && t->height == surface_data->height &&
+	    t->components == components && t->uv_shift == uv_shift)
+		return t->n_y;
+
+	his_tiles_free(t);
+
+	const uint32_t n_x = (surface_data->width + HIS_TILE_SIZE - 1) / HIS_TILE_SIZE;
+	const uint32_t n_y = (surface_data->height + HIS_TILE_SIZE - 1) / HIS_TILE_SIZE;
+	const size_t n = (size_t)n_x * n_y;
+	if (!n)
+		return 0;
+
+	t->hash = calloc(n, sizeof(uint64_t));
+	t->valid = calloc(n, sizeof(bool));
+	t->counts = calloc(n * HIS_TILES_BINS, sizeof(uint16_t));
+	if (!t->hash || !t->valid || !t->counts) {
+		his_tiles_free(t);
+		return 0;
+	}
+
+	t->width = surface_data->width;
+	t->height = surface_data->height;
+	t->components = components;
+	t->uv_shift = uv_shift;
+	t->n_x = n_x;
+	t->n_y = n_y;
+	return n_y;
+}
+
+// Hashes the bytes read by his_kernel_accumulate for the tile.
+static uint64_t tile_hash(const struct his_tiles *t, const struct cm_surface_data *sd, uint32_t x0, uint32_t x1,
+			  uint32_t y0, uint32_t y1)
+{
+	const uint32_t w = x1 - x0, h = y1 - y0;
+	uint64_t hash = 0;
+
+	if (t->components & 0x07)
+		return cm_fingerprint(sd->rgb_data + (size_t)sd->linesize * y0 + x0 * 4, sd->linesize, w * 4, h, 1);
+
+	if (t->components & 0x20)
+		hash = cm_fingerprint(sd->y_data + (size_t)sd->y_linesize * y0 + x0, sd->y_linesize, w, h, 1);
+	if (t->components & 0x50) {
+		// The tiles start at even positions so that a subsampled chroma sample belongs to one tile.
+		const uint32_t ux0 = x0 >> sd->uv_shift_x;
+		const uint32_t uw = ((x1 + (1u << sd->uv_shift_x) - 1) >> sd->uv_shift_x) - ux0;
+		const uint32_t uy0 = cm_surface_uv_row(sd, y0);
+		const uint32_t uh = cm_surface_uv_row(sd, y1) - uy0;
+		const uint8_t *u = sd->u_data + (size_t)sd->uv_linesize * uy0 + ux0 * sd->uv_step;
+		const uint8_t *v = sd->v_data + (size_t)sd->uv_linesize * uy0 + ux0 * sd->uv_step;
+		const uint32_t span = (uw - 1) * sd->uv_step + 1;
+		if ((t->components & 0x50) == 0x50 && (v == u + 1 || u == v + 1) && sd->uv_step >= 2) {
+			// Interleaved U and V are hashed together.
+			const uint8_t *uv = u < v ? u : v;
+			hash = cm_fingerprint_mix(hash, cm_fingerprint(uv, sd->uv_linesize, span + 1, uh, 1));
+		} else {
+			if (t->components & 0x10)
+				hash = cm_fingerprint_mix(hash, cm_fingerprint(u, sd->uv_linesize, span, uh, 1));
+			if (t->components & 0x40)
+				hash = cm_fingerprint_mix(hash, cm_fingerprint(v, sd->uv_linesize, span, uh, 1));
+		}
+	}
+	return hash;
+}
+
+static void accumulate_tile(uint32_t *dbuf, const struct his_tiles *t, const struct cm_surface_data *sd,
+			    uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1)
+{
+	struct cm_surface_data sub = *sd;
+	sub.width = x1 - x0;
+	if (sub.rgb_data)
+		sub.rgb_data += x0 * 4;
+	if (sub.y_data)
+		sub.y_data += x0;
+	if (sub.u_data)
+		sub.u_data += (x0 >> sd->uv_shift_x) * sd->uv_step;
+	if (sub.v_data)
+		sub.v_data += (x0 >> sd->uv_shift_x) * sd->uv_step;
+
+	his_kernel_accumulate(dbuf, &sub, t->components, y0, y1);
+}
+
+uint32_t his_tiles_update(struct his_tiles *t, uint32_t *delta, const struct cm_surface_data *surface_data,
+			  uint32_t ty0, uint32_t ty1)
+{
+	uint32_t tmp[HIS_TILES_BINS];
+	uint32_t n_changed = 0;
+
+	for (uint32_t ty = ty0; ty < ty1; ty++) {
+		const uint32_t y0 = ty * HIS_TILE_SIZE;
+		const uint32_t y1 = y0 + HIS_TILE_SIZE < t->height ? y0 + HIS_TILE_SIZE : t->height;
+
+		for (uint32_t tx = 0; tx < t->n_x; tx++) {
+			const uint32_t x0 = tx * HIS_TILE_SIZE;
+			const uint32_t x1 = x0 + HIS_TILE_SIZE < t->width ? x0 + HIS_TILE_SIZE : t->width;
+			const size_t i = (size_t)ty * t->n_x + tx;
+
+			const uint64_t hash = tile_hash(t, surface_data, x0, x1, y0, y1);
+			if (t->valid[i] && t->hash[i] == hash)
+				continue;
+
+			memset(tmp, 0, sizeof(tmp));
+			accumulate_tile(tmp, t, surface_data, x0, x1, y0, y1);
+
+			uint16_t *counts = t->counts + i * HIS_TILES_BINS;
+			for (int j = 0; j < HIS_TILES_BINS; j++) {
+				delta[j] += tmp[j] - counts[j];
+				counts[j] = (uint16_t)tmp[j];
+			}
+
+			t->hash[i] = hash;
+			t->valid[i] = true;
+			n_changed++;
+		}
+	}
+
+	return n_changed;
+}
+
+void his_tiles_commit(struct his_tiles *t, const uint32_t *delta)
+{
+	for (int j = 0; j < HIS_TILES_BINS; j++)
+		t->total[j] += delta[j];
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremental histogram over tiles of HIS_TILE_SIZE x HIS_TILE_SIZE pixels.
+ * Each tile keeps the hash of its pixels and its own histogram. When a frame comes, only the tiles
+ * whose hash has changed are accumulated again, and the difference from their previous histogram is
+ * added to the histogram of the whole frame.
+ * The layout of the histograms is same as `dbuf` of histogram-kernel.h.
+ * This file does not depend on libobs.
+ *
+ * Usage for each frame:
+ *   n = his_tiles_begin(t, sd, components);
+ *   clear `delta`, then his_tiles_update(t, delta, sd, ty0, ty1) for the tile rows [0, n),
+ *     which can be split into bands running in parallel, each with its own `delta`;
+ *   his_tiles_commit(t, delta) for each `delta`;
+ *   read `t->total`.
+ */
+
+#define HIS_TILE_SIZE 64
+#define HIS_TILES_BINS (256 * 4)
+
+struct his_tiles
+{
+	uint32_t width, height, components;
+	uint32_t uv_shift; // uv_shift_x | uv_shift_y << 8 of the surface
+	uint32_t n_x, n_y;
+	uint64_t *hash; // n_x * n_y
+	bool *valid; // n_x * n_y; an invalid tile is accumulated regardless of the hash
+	uint16_t *counts; // HIS_TILES_BINS for each tile; a tile has 4096 pixels at most
+	uint32_t total[HIS_TILES_BINS];
+};
+
+void his_tiles_init(struct his_tiles *t);
+void his_tiles_free(struct his_tiles *t);
+
+// All tiles are accumulated again at the next frame.
+void his_tiles_invalidate(struct his_tiles *t);
+
+/*
+ * Prepares the tiles for the frame and returns the number of tile rows.
+ * If the size or the components differ from the previous frame, the tiles are reset.
+ * Returns 0 if the memory cannot be allocated.
+ */
+uint32_t his_tiles_begin(struct his_tiles *t, const struct cm_surface_data *surface_data, uint32_t components);
+
+/*
+ * Accumulates the changed tiles in the tile rows [ty0, ty1) and adds the difference to `delta`,
+ * which has HIS_TILES_BINS elements. The elements wrap around so that `delta` can be negative.
+ * Returns the number of the changed tiles.
+ */
+uint32_t his_tiles_update(struct his_tiles *t, uint32_t *delta, const struct cm_surface_data *surface_data,
+			  uint32_t ty0, uint32_t ty1);
+
+void his_tiles_commit(struct his_tiles *t, const uint32_t *delta);
+
+#ifdef __cplusplus
+}
+#endif
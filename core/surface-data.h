@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gs_texture;
+
+/*
+ * A frame given to the scopes.
+ * This file does not depend on libobs so that the kernels can be built without it.
+ */
+struct cm_surface_data
+{
+	uint8_t *rgb_data; // BGRA
+	uint32_t linesize, width, height;
+
+	// 8-bit planes; a sample of `u_data` and `v_data` is `uv_step` bytes apart from the next one.
+	uint8_t *y_data, *u_data, *v_data;
+	uint32_t y_linesize, uv_linesize;
+	uint32_t uv_step;
+
+	/* Subsampling of `u_data` and `v_data`; 1 to halve the width or the height, eg. both 1 for 4:2:0.
+	 * The chroma planes have cm_surface_uv_width x cm_surface_uv_height samples. */
+	uint32_t uv_shift_x, uv_shift_y;
+
+	int colorspace;
+	uint64_t timestamp; // ns, 0 if unknown
+	struct gs_texture *tex; // for bypass mode
+};
+
+static inline uint32_t cm_surface_uv_width(const struct cm_surface_data *sd)
+{
+	return (sd->width + (1u << sd->uv_shift_x) - 1) >> sd->uv_shift_x;
+}
+
+static inline uint32_t cm_surface_uv_height(const struct cm_surface_data *sd)
+{
+	return (sd->height + (1u << sd->uv_shift_y) - 1) >> sd->uv_shift_y;
+}
+
+/* Returns the first chroma row of the luma row `y`.
+ * The luma rows [y0, y1) map to the chroma rows [cm_surface_uv_row(y0), cm_surface_uv_row(y1)) so that
+ * the bands of the luma rows split the chroma rows without overlap. */
+static inline uint32_t cm_surface_uv_row(const struct cm_surface_data *sd, uint32_t y)
+{
+	return (y + (1u << sd->uv_shift_y) - 1) >> sd->uv_shift_y;
+}
+
+#ifdef __cplusplus
+}
+#endif
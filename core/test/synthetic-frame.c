@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include "synthetic-frame.h"
+#include "yuv-convert.h"
+
+const char *synthetic_patterns[] = {"flat", "gradient", "noise", "smpte", "alpha-holes"};
+const uint32_t synthetic_patterns_count = sizeof(synthetic_patterns) / sizeof(*synthetic_patterns);
+
+static inline uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static inline void put_bgra(uint8_t *p, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	p[0] = b;
+	p[1] = g;
+	p[2] = r;
+	p[3] = a;
+}
+
+static bool fill_pattern(uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height, const char *pattern)
+{
+	// 75% color bars; white, yellow, cyan, green, magenta, red, blue
+	static const uint8_t bars[7][3] = {
+		{191, 191, 191}, {191, 191, 0}, {0, 191, 191}, {0, 191, 0}, {191, 0, 191}, {191, 0, 0}, {0, 0, 191},
+	};
+	const uint32_t x_div = width > 1 ? width - 1 : 1;
+	const uint32_t y_div = height > 1 ? height - 1 : 1;
+	uint32_t seed = 0x12345678;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *line = rgb_data + linesize * y;
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t *p = line + x * 4;
+			if (!strcmp(pattern, "flat")) {
+				put_bgra(p, 128, 128, 128, 255);
+			} else if (!strcmp(pattern, "gradient")) {
+				put_bgra(p, (uint8_t)(x * 255 / x_div), (uint8_t)(y * 255 / y_div),
+					 (uint8_t)((x + y) * 255 / (x_div + y_div)), 255);
+			} else if (!strcmp(pattern, "noise")) {
+				uint32_t r = xorshift32(&seed);
+				put_bgra(p, (uint8_t)r, (uint8_t)(r >> 8), (uint8_t)(r >> 16), 255);
+			} else if (!strcmp(pattern, "smpte")) {
+				const uint8_t *c = bars[x * 7 / width];
+				if (y >= height * 3 / 4)
+					put_bgra(p, 16, 16, 16, 255);
+				else
+					put_bgra(p, c[0], c[1], c[2], 255);
+			} else if (!strcmp(pattern, "alpha-holes")) {
+				// Noise with transparent 64x64 blocks on a checkerboard, like a source not covering the
+				// canvas.
+				uint32_t r = xorshift32(&seed);
+				uint8_t a = ((x / 64) ^ (y / 64)) & 1 ? 0 : 255;
+				put_bgra(p, (uint8_t)r, (uint8_t)(r >> 8), (uint8_t)(r >> 16), a);
+			} else {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool synthetic_frame_init(struct synthetic_frame *frame, const char *pattern, uint32_t width, uint32_t height)
+{
+	memset(frame, 0, sizeof(*frame));
+	frame->pattern = pattern;
+	frame->rgb_data = malloc((size_t)width * height * 4);
+	frame->y_data = malloc((size_t)width * height);
+	frame->uv_data = malloc((size_t)width * height * 2);
+	if (!frame->rgb_data || !frame->y_data || !frame->uv_data)
+		return false;
+
+	if (!fill_pattern(frame->rgb_data, width * 4, width, height, pattern))
+		return false;
+	cm_rgb_to_yuv_scalar(frame->y_data, width, frame->uv_data, width * 2, frame->rgb_data, width * 4, width,
+			     height, false);
+
+	struct cm_surface_data *sd = &frame->sd;
+	sd->rgb_data = frame->rgb_data;
+	sd->linesize = width * 4;
+	sd->width = width;
+	sd->height = height;
+	sd->y_data = frame->y_data;
+	sd->y_linesize = width;
+	sd->u_data = frame->uv_data;
+	sd->v_data = frame->uv_data + 1;
+	sd->uv_linesize = width * 2;
+	sd->uv_step = 2;
+	sd->colorspace = 2;
+	return true;
+}
+
+void synthetic_frame_free(struct synthetic_frame *frame)
+{
+	free(frame->rgb_data);
+	free(frame->y_data);
+	free(frame->uv_data);
+	frame->rgb_data = frame->y_data = frame->uv_data = NULL;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Deterministic frames for the tests and the benchmark.
+ * `rgb_data` is BGRA. The Y and interleaved UV planes are converted from it by `cm_rgb_to_yuv_scalar` in BT.709.
+ */
+
+struct synthetic_frame
+{
+	const char *pattern;
+	uint8_t *rgb_data;
+	uint8_t *y_data;
+	uint8_t *uv_data;
+	struct cm_surface_data sd;
+};
+
+// "flat", "gradient", "noise", "smpte", and "alpha-holes"
+extern const char *synthetic_patterns[];
+extern const uint32_t synthetic_patterns_count;
+
+// Returns false if `pattern` is unknown or the allocation failed. Call `synthetic_frame_free` in any case.
+bool synthetic_frame_init(struct synthetic_frame *frame, const char *pattern, uint32_t width, uint32_t height);
+void synthetic_frame_free(struct synthetic_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Test of the assembly of a frame from bands.
+ * The assembled frame has to be same as the frame the bands were cut from, and has to be given only
+ * after all the bands have been copied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synthetic-frame.h"
+#include "band-assembly.h"
+#include "histogram-kernel.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+// The first row of the band as the plugin reads them back; all bands but the last one have the same even height.
+static uint32_t band_row(uint32_t height, uint32_t index, uint32_t n_bands)
+{
+	const uint32_t band_height = ((height + n_bands - 1) / n_bands + 1) & ~1u;
+	const uint32_t y = band_height * index;
+	return index >= n_bands || y > height ? height : y;
+}
+
+static struct cm_surface_data cut_band(const struct cm_surface_data *sd, uint32_t y0, uint32_t y1)
+{
+	struct cm_surface_data band = *sd;
+	band.height = y1 - y0;
+	if (band.rgb_data)
+		band.rgb_data += (size_t)sd->linesize * y0;
+	if (band.y_data)
+		band.y_data += (size_t)sd->y_linesize * y0;
+	if (band.u_data) {
+		const uint32_t uv_y0 = y0 >> sd->uv_shift_y;
+		band.u_data += (size_t)sd->uv_linesize * uv_y0;
+		band.v_data += (size_t)sd->uv_linesize * uv_y0;
+	}
+	return band;
+}
+
+static bool same_rows(const uint8_t *a, uint32_t a_linesize, const uint8_t *b, uint32_t b_linesize,
+		      uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++) {
+		if (memcmp(a + (size_t)a_linesize * y, b + (size_t)b_linesize * y, row_bytes))
+			return false;
+	}
+	return true;
+}
+
+static bool same_histogram(const struct cm_surface_data *a, const struct cm_surface_data *b, uint32_t components)
+{
+	static uint32_t ha[256 * 4], hb[256 * 4];
+	memset(ha, 0, sizeof(ha));
+	memset(hb, 0, sizeof(hb));
+	his_kernel_accumulate(ha, a, components, 0, a->height);
+	his_kernel_accumulate(hb, b, components, 0, b->height);
+	return memcmp(ha, hb, sizeof(ha)) == 0;
+}
+
+static void test_bands(const struct cm_surface_data *sd, uint32_t n_bands)
+{
+	struct cm_band_assembly a;
+	cm_band_assembly_init(&a);
+
+	// Reversed order; only the last band completes the frame.
+	for (uint32_t i = n_bands; i-- > 0;) {
+		const uint32_t y0 = band_row(sd->height, i, n_bands);
+		const struct cm_surface_data band = cut_band(sd, y0, band_row(sd->height, i + 1, n_bands));
+		CHECK(cm_band_assembly_add(&a, &band, y0, sd->height, i, n_bands) == (i == 0));
+	}
+
+	const struct cm_surface_data *as = &a.sd;
+	CHECK(as->width == sd->width && as->height == sd->height);
+	if (sd->rgb_data) {
+		CHECK(same_rows(as->rgb_data, as->linesize, sd->rgb_data, sd->linesize, sd->width * 4, sd->height));
+		CHECK(same_histogram(as, sd, 0x07));
+	}
+	if (sd->y_data)
+		CHECK(same_rows(as->y_data, as->y_linesize, sd->y_data, sd->y_linesize, sd->width, sd->height));
+	if (sd->u_data) {
+		CHECK(as->uv_shift_x == sd->uv_shift_x && as->uv_shift_y == sd->uv_shift_y);
+		CHECK(same_histogram(as, sd, sd->y_data ? 0x70 : 0x50));
+	}
+
+	// A repeated band does not complete the frame.
+	const struct cm_surface_data band = cut_band(sd, 0, band_row(sd->height, 1, n_bands));
+	CHECK(!cm_band_assembly_add(&a, &band, 0, sd->height, 0, n_bands) || n_bands == 1);
+	CHECK(!cm_band_assembly_add(&a, &band, 0, sd->height, 0, n_bands) || n_bands == 1);
+
+	// A different number of bands restarts the assembly.
+	if (n_bands > 1) {
+		const struct cm_surface_data whole = cut_band(sd, 0, sd->height);
+		CHECK(cm_band_assembly_add(&a, &whole, 0, sd->height, 0, 1));
+	}
+
+	// Invalid bands
+	CHECK(!cm_band_assembly_add(&a, &band, 0, sd->height, n_bands, n_bands));
+	CHECK(!cm_band_assembly_add(&a, &band, sd->height, sd->height, 0, n_bands));
+
+	cm_band_assembly_free(&a);
+}
+
+static void test_fingerprint(const struct synthetic_frame *f)
+{
+	struct cm_band_assembly a;
+	cm_band_assembly_init(&a);
+
+	CHECK(cm_band_assembly_add(&a, &f->sd, 0, f->sd.height, 0, 1));
+	const uint64_t fp = cm_band_assembly_fingerprint(&a, 1);
+	CHECK(cm_band_assembly_add(&a, &f->sd, 0, f->sd.height, 0, 1));
+	CHECK(cm_band_assembly_fingerprint(&a, 1) == fp);
+
+	a.sd.y_data[a.sd.y_linesize * (f->sd.height - 1)] ^= 1;
+	CHECK(cm_band_assembly_fingerprint(&a, 1) != fp);
+
+	cm_band_assembly_free(&a);
+}
+
+int main(void)
+{
+	his_kernel_init();
+
+	for (uint32_t i = 0; i < synthetic_patterns_count; i++) {
+		struct synthetic_frame f;
+		CHECK(synthetic_frame_init(&f, synthetic_patterns[i], 160, 90));
+
+		for (uint32_t n_bands = 1; n_bands <= 8; n_bands++)
+			test_bands(&f.sd, n_bands);
+
+		// YUV only, as the vectorscope reads back.
+		struct cm_surface_data yuv = f.sd;
+		yuv.rgb_data = NULL;
+		test_bands(&yuv, 4);
+
+		// 4:2:0 view of the interleaved UV; every other sample of every other row.
+		struct cm_surface_data sub = yuv;
+		sub.y_data = NULL;
+		sub.uv_linesize = f.sd.uv_linesize * 2;
+		sub.uv_step = 4;
+		sub.uv_shift_x = 1;
+		sub.uv_shift_y = 1;
+		test_bands(&sub, 3);
+
+		test_fingerprint(&f);
+		synthetic_frame_free(&f);
+	}
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Test of the kernels with subsampled chroma.
+ * A 4:2:0 frame has to give the same result as the 4:4:4 frame whose chroma is repeated over 2x2 pixels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synthetic-frame.h"
+#include "histogram-kernel.h"
+#include "histogram-tiles.h"
+#include "waveform-kernel.h"
+#include "vectorscope-kernel.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+struct frame_pair
+{
+	struct synthetic_frame frame;
+	uint8_t *uv_444; // interleaved UV repeated over 2x2 pixels
+	uint8_t *u_420, *v_420; // planar like I420
+	struct cm_surface_data full, sub;
+};
+
+static bool frame_pair_init(struct frame_pair *p, const char *pattern, uint32_t width, uint32_t height)
+{
+	memset(p, 0, sizeof(*p));
+	if (!synthetic_frame_init(&p->frame, pattern, width, height))
+		return false;
+
+	const uint32_t uw = (width + 1) / 2, uh = (height + 1) / 2;
+	p->uv_444 = malloc((size_t)width * 2 * height);
+	p->u_420 = malloc((size_t)uw * uh);
+	p->v_420 = malloc((size_t)uw * uh);
+	if (!p->uv_444 || !p->u_420 || !p->v_420)
+		return false;
+
+	const uint8_t *uv = p->frame.uv_data;
+	for (uint32_t y = 0; y < uh; y++) {
+		for (uint32_t x = 0; x < uw; x++) {
+			const uint8_t u = uv[(size_t)width * 2 * (y * 2) + x * 4];
+			const uint8_t v = uv[(size_t)width * 2 * (y * 2) + x * 4 + 1];
+			p->u_420[(size_t)uw * y + x] = u;
+			p->v_420[(size_t)uw * y + x] = v;
+			for (uint32_t yy = y * 2; yy < y * 2 + 2 && yy < height; yy++) {
+				for (uint32_t xx = x * 2; xx < x * 2 + 2 && xx < width; xx++) {
+					p->uv_444[(size_t)width * 2 * yy + xx * 2] = u;
+					p->uv_444[(size_t)width * 2 * yy + xx * 2 + 1] = v;
+				}
+			}
+		}
+	}
+
+	p->full = p->frame.sd;
+	p->full.rgb_data = NULL;
+	p->full.u_data = p->uv_444;
+	p->full.v_data = p->uv_444 + 1;
+
+	p->sub = p->full;
+	p->sub.u_data = p->u_420;
+	p->sub.v_data = p->v_420;
+	p->sub.uv_linesize = uw;
+	p->sub.uv_step = 1;
+	p->sub.uv_shift_x = 1;
+	p->sub.uv_shift_y = 1;
+	return true;
+}
+
+static void frame_pair_free(struct frame_pair *p)
+{
+	synthetic_frame_free(&p->frame);
+	free(p->uv_444);
+	free(p->u_420);
+	free(p->v_420);
+}
+
+static uint32_t his_full[256 * 4], his_sub[256 * 4];
+
+static void test_histogram(const struct frame_pair *p, uint32_t components)
+{
+	const uint32_t h = p->full.height;
+	memset(his_full, 0, sizeof(his_full));
+	memset(his_sub, 0, sizeof(his_sub));
+	his_kernel_accumulate(his_full, &p->full, components, 0, h);
+
+	// Bands split at odd rows must not count a chroma row twice.
+	his_kernel_accumulate(his_sub, &p->sub, components, 0, h / 3 | 1);
+	his_kernel_accumulate(his_sub, &p->sub, components, h / 3 | 1, h);
+
+	if (p->full.width % 2 == 0 && h % 2 == 0)
+		CHECK(memcmp(his_full, his_sub, sizeof(his_full)) == 0);
+
+	// The total is the number of the pixels even if the size is odd.
+	uint64_t sum = 0;
+	for (int i = 0; i < 256; i++)
+		sum += his_sub[i * 4 + 2];
+	if (components & 0x10)
+		CHECK(sum >= (uint64_t)p->full.width * h);
+}
+
+static void test_histogram_tiles(const struct frame_pair *p, uint32_t components)
+{
+	struct his_tiles t;
+	his_tiles_init(&t);
+
+	const uint32_t n = his_tiles_begin(&t, &p->sub, components);
+	CHECK(n > 0);
+	memset(his_sub, 0, sizeof(his_sub));
+	his_tiles_update(&t, his_sub, &p->sub, 0, n);
+	his_tiles_commit(&t, his_sub);
+
+	memset(his_full, 0, sizeof(his_full));
+	his_kernel_accumulate(his_full, &p->sub, components, 0, p->sub.height);
+	CHECK(memcmp(his_full, t.total, sizeof(his_full)) == 0);
+
+	// Static frame
+	memset(his_sub, 0, sizeof(his_sub));
+	CHECK(his_tiles_update(&t, his_sub, &p->sub, 0, n) == 0);
+
+	his_tiles_free(&t);
+}
+
+static void test_waveform(const struct frame_pair *p, uint32_t components)
+{
+	const uint32_t out_width = p->full.width / 2;
+	const size_t size = (size_t)out_width * WVS_KERNEL_SIZE * 4;
+	uint8_t *full = calloc(1, size);
+	uint8_t *sub = calloc(1, size);
+	CHECK(full && sub);
+	if (full && sub) {
+		wvs_kernel_columns(full, &p->full, components, out_width, 0, out_width);
+		wvs_kernel_columns(sub, &p->sub, components, out_width, 0, out_width);
+		CHECK(memcmp(full, sub, size) == 0);
+	}
+	free(full);
+	free(sub);
+}
+
+static void test_vectorscope(const struct frame_pair *p)
+{
+	const size_t size = VSS_KERNEL_SIZE * VSS_KERNEL_SIZE;
+	uint8_t *full = calloc(1, size);
+	uint8_t *sub = calloc(1, size);
+	CHECK(full && sub);
+	if (full && sub) {
+		vss_kernel_rows(full, &p->full, 0, p->full.height);
+		vss_kernel_rows(sub, &p->sub, 0, p->sub.height);
+		CHECK(memcmp(full, sub, size) == 0);
+	}
+	free(full);
+	free(sub);
+}
+
+int main(void)
+{
+	his_kernel_init();
+
+	for (uint32_t i = 0; i < synthetic_patterns_count; i++) {
+		struct frame_pair p;
+
+		CHECK(frame_pair_init(&p, synthetic_patterns[i], 160, 90));
+		test_histogram(&p, 0x50);
+		test_histogram(&p, 0x70);
+		test_histogram_tiles(&p, 0x50);
+		test_waveform(&p, 0x50);
+		test_waveform(&p, 0x70);
+		test_vectorscope(&p);
+		frame_pair_free(&p);
+
+		// Odd size; the last chroma column and row cover one luma sample.
+		CHECK(frame_pair_init(&p, synthetic_patterns[i], 131, 77));
+		test_histogram(&p, 0x50);
+		test_histogram_tiles(&p, 0x70);
+		frame_pair_free(&p);
+	}
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,517 @@
+/*
+ * Randomized differential test of the kernels.
+ * Frames having random sizes, linesizes, padding, and alpha are given to every variant of the kernels,
+ * and the results are compared with straightforward scalar loops written below, which are same as the
+ * loops the scopes had before the kernels were optimized. Any difference in a bin is a failure.
+ *
+ * Usage: test-differential [--iterations N] [--seed S]
+ *
+ * If built with CM_FUZZING, `LLVMFuzzerTestOneInput` takes the parameters and the pixels from the input
+ * instead of the random generator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "histogram-kernel.h"
+#include "waveform-kernel.h"
+#include "vectorscope-kernel.h"
+#include "yuv-convert.h"
+
+#define MAX_WIDTH 700
+#define MAX_HEIGHT 300
+#define MAX_PADDING 67
+
+static int n_failed;
+static int n_checked;
+
+struct source
+{
+	const uint8_t *data;
+	size_t size, pos;
+	uint64_t state;
+};
+
+// Returns bytes from the fuzzer input if any, then from xorshift64.
+static uint32_t next(struct source *s)
+{
+	if (s->pos + 4 <= s->size) {
+		uint32_t v;
+		memcpy(&v, s->data + s->pos, 4);
+		s->pos += 4;
+		return v;
+	}
+	uint64_t x = s->state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	s->state = x;
+	return (uint32_t)(x >> 32);
+}
+
+static uint32_t next_range(struct source *s, uint32_t lo, uint32_t hi)
+{
+	return lo + next(s) % (hi - lo + 1);
+}
+
+enum alpha_pattern {
+	ALPHA_OPAQUE,
+	ALPHA_TRANSPARENT,
+	ALPHA_RANDOM,
+	ALPHA_SPARSE,
+	ALPHA_BLOCKS,
+	ALPHA_ONE, // alpha is 1, which is not transparent
+	N_ALPHA_PATTERNS,
+};
+
+enum value_pattern {
+	VALUE_RANDOM,
+	VALUE_FLAT, // saturates the counters
+	VALUE_NARROW,
+	VALUE_EXTREME, // 0 and 255 only
+	N_VALUE_PATTERNS,
+};
+
+struct frame
+{
+	uint8_t *rgb, *y, *uv;
+	uint32_t width, height;
+	uint32_t linesize, y_linesize, uv_linesize, uv_step;
+	uint32_t v_offset; // offset of the V sample from the U sample
+	enum alpha_pattern alpha;
+	enum value_pattern value;
+};
+
+static uint8_t gen_value(struct source *s, enum value_pattern pattern, uint8_t flat)
+{
+	switch (pattern) {
+	case VALUE_FLAT:
+		return flat;
+	case VALUE_NARROW:
+		return (uint8_t)(flat + next(s) % 4);
+	case VALUE_EXTREME:
+		return next(s) & 1 ? 255 : 0;
+	default:
+		return (uint8_t)next(s);
+	}
+}
+
+static uint8_t gen_alpha(struct source *s, enum alpha_pattern pattern, uint32_t x, uint32_t y)
+{
+	switch (pattern) {
+	case ALPHA_OPAQUE:
+		return 255;
+	case ALPHA_TRANSPARENT:
+		return 0;
+	case ALPHA_SPARSE:
+		return next(s) % 16 ? 0 : (uint8_t)next_range(s, 1, 255);
+	case ALPHA_BLOCKS:
+		return ((x / 5) ^ (y / 3)) & 1 ? 0 : 255;
+	case ALPHA_ONE:
+		return 1;
+	default:
+		return next(s) & 1 ? (uint8_t)next_range(s, 1, 255) : 0;
+	}
+}
+
+/*
+ * The padding at the end of the lines is filled with opaque random pixels
+ * so that a kernel reading beyond the width changes the result.
+ */
+static bool frame_init(struct frame *f, struct source *s)
+{
+	memset(f, 0, sizeof(*f));
+	f->width = next_range(s, 1, MAX_WIDTH);
+	f->height = next_range(s, 1, MAX_HEIGHT);
+	f->linesize = f->width * 4 + next_range(s, 0, MAX_PADDING) * 4;
+	f->y_linesize = f->width + next_range(s, 0, MAX_PADDING);
+	static const uint32_t uv_steps[] = {1, 2, 4};
+	f->uv_step = uv_steps[next(s) % 3];
+	f->uv_linesize = f->width * f->uv_step + next_range(s, 0, MAX_PADDING);
+	// V follows U in the same line if interleaved, otherwise V is on a separate plane below U.
+	f->v_offset = f->uv_step > 1 ? next_range(s, 1, f->uv_step - 1) : f->uv_linesize * f->height;
+	f->alpha = (enum alpha_pattern)(next(s) % N_ALPHA_PATTERNS);
+	f->value = (enum value_pattern)(next(s) % N_VALUE_PATTERNS);
+
+	const size_t uv_size = (size_t)f->uv_linesize * f->height * (f->uv_step > 1 ? 1 : 2);
+	f->rgb = malloc((size_t)f->linesize * f->height);
+	f->y = malloc((size_t)f->y_linesize * f->height);
+	f->uv = malloc(uv_size);
+	if (!f->rgb || !f->y || !f->uv)
+		return false;
+
+	for (size_t i = 0; i < (size_t)f->linesize * f->height; i++)
+		f->rgb[i] = (uint8_t)(next(s) | (i % 4 == 3 ? 0x80 : 0));
+	for (size_t i = 0; i < (size_t)f->y_linesize * f->height; i++)
+		f->y[i] = (uint8_t)next(s);
+	for (size_t i = 0; i < uv_size; i++)
+		f->uv[i] = (uint8_t)next(s);
+
+	const uint8_t flat = (uint8_t)next(s);
+	for (uint32_t y = 0; y < f->height; y++) {
+		uint8_t *p = f->rgb + (size_t)f->linesize * y;
+		uint8_t *py = f->y + (size_t)f->y_linesize * y;
+		uint8_t *pu = f->uv + (size_t)f->uv_linesize * y;
+		for (uint32_t x = 0; x < f->width; x++) {
+			p[x * 4 + 0] = gen_value(s, f->value, flat);
+			p[x * 4 + 1] = gen_value(s, f->value, flat);
+			p[x * 4 + 2] = gen_value(s, f->value, flat);
+			p[x * 4 + 3] = gen_alpha(s, f->alpha, x, y);
+			py[x] = gen_value(s, f->value, flat);
+			pu[x * f->uv_step] = gen_value(s, f->value, flat);
+			pu[x * f->uv_step + f->v_offset] = gen_value(s, f->value, flat);
+		}
+	}
+	return true;
+}
+
+static void frame_free(struct frame *f)
+{
+	free(f->rgb);
+	free(f->y);
+	free(f->uv);
+}
+
+static struct cm_surface_data frame_surface(const struct frame *f)
+{
+	struct cm_surface_data sd = {
+		.rgb_data = f->rgb,
+		.linesize = f->linesize,
+		.width = f->width,
+		.height = f->height,
+		.y_data = f->y,
+		.u_data = f->uv,
+		.v_data = f->uv + f->v_offset,
+		.y_linesize = f->y_linesize,
+		.uv_linesize = f->uv_linesize,
+		.uv_step = f->uv_step,
+	};
+	return sd;
+}
+
+static void report(const char *what, const char *variant, const struct frame *f, size_t bin, uint32_t expected,
+		   uint32_t got)
+{
+	n_failed++;
+	if (n_failed > 20)
+		return;
+	printf("FAIL %s (%s): %ux%u linesize=%u y_linesize=%u uv_linesize=%u uv_step=%u alpha=%d value=%d: "
+	       "bin %zu expected %u, got %u\n",
+	       what, variant, f->width, f->height, f->linesize, f->y_linesize, f->uv_linesize, f->uv_step,
+	       (int)f->alpha, (int)f->value, bin, expected, got);
+}
+
+static void compare_u32(const char *what, const char *variant, const struct frame *f, const uint32_t *expected,
+			const uint32_t *got, size_t n)
+{
+	n_checked++;
+	for (size_t i = 0; i < n; i++) {
+		if (expected[i] != got[i]) {
+			report(what, variant, f, i, expected[i], got[i]);
+			return;
+		}
+	}
+}
+
+static void compare_u8(const char *what, const char *variant, const struct frame *f, const uint8_t *expected,
+		       const uint8_t *got, size_t n)
+{
+	n_checked++;
+	for (size_t i = 0; i < n; i++) {
+		if (expected[i] != got[i]) {
+			report(what, variant, f, i, expected[i], got[i]);
+			return;
+		}
+	}
+}
+
+static inline void inc_uint8(uint8_t *c)
+{
+	if (*c < 255)
+		++*c;
+}
+
+static void ref_histogram(uint32_t *dbuf, const struct cm_surface_data *sd, uint32_t components)
+{
+	memset(dbuf, 0, sizeof(uint32_t) * 256 * 4);
+	for (uint32_t y = 0; y < sd->height; y++) {
+		for (uint32_t x = 0; x < sd->width; x++) {
+			if (components & 0x07) {
+				const uint8_t *v = sd->rgb_data + sd->linesize * y + x * 4;
+				if (!v[3])
+					continue;
+				if (components & 0x04)
+					dbuf[v[2] * 4 + 0]++;
+				if (components & 0x02)
+					dbuf[v[1] * 4 + 1]++;
+				if (components & 0x01)
+					dbuf[v[0] * 4 + 2]++;
+			} else {
+				const size_t uv = (size_t)sd->uv_linesize * y + x * sd->uv_step;
+				if (components & 0x40)
+					dbuf[sd->v_data[uv] * 4 + 0]++;
+				if (components & 0x20)
+					dbuf[sd->y_data[sd->y_linesize * y + x] * 4 + 1]++;
+				if (components & 0x10)
+					dbuf[sd->u_data[uv] * 4 + 2]++;
+			}
+		}
+	}
+}
+
+static void ref_waveform(uint8_t *dbuf, const struct cm_surface_data *sd, uint32_t components, uint32_t out_width)
+{
+	memset(dbuf, 0, (size_t)out_width * WVS_KERNEL_SIZE * 4);
+	for (uint32_t y = 0; y < sd->height; y++) {
+		for (uint32_t x = 0; x < sd->width; x++) {
+			const uint32_t o = (uint32_t)((uint64_t)x * out_width / sd->width);
+			uint8_t *d = dbuf + o * 4;
+			const size_t row = (size_t)out_width * 4;
+			if (components & 0x07) {
+				const uint8_t *v = sd->rgb_data + sd->linesize * y + x * 4;
+				if (!v[3])
+					continue;
+				if (components & 0x01)
+					inc_uint8(d + (255 - v[0]) * row + 0);
+				if (components & 0x02)
+					inc_uint8(d + (255 - v[1]) * row + 1);
+				if (components & 0x04)
+					inc_uint8(d + (255 - v[2]) * row + 2);
+			} else {
+				const size_t uv = (size_t)sd->uv_linesize * y + x * sd->uv_step;
+				if (components & 0x10)
+					inc_uint8(d + (255 - sd->u_data[uv]) * row + 0);
+				if (components & 0x20)
+					inc_uint8(d + (255 - sd->y_data[sd->y_linesize * y + x]) * row + 1);
+				if (components & 0x40)
+					inc_uint8(d + (255 - sd->v_data[uv]) * row + 2);
+			}
+		}
+	}
+}
+
+static void ref_vectorscope(uint8_t *dbuf, const struct cm_surface_data *sd)
+{
+	memset(dbuf, 0, VSS_KERNEL_SIZE * VSS_KERNEL_SIZE);
+	for (uint32_t y = 0; y < sd->height; y++) {
+		for (uint32_t x = 0; x < sd->width; x++) {
+			const size_t uv = (size_t)sd->uv_linesize * y + x * sd->uv_step;
+			inc_uint8(dbuf + sd->u_data[uv] + VSS_KERNEL_SIZE * (255 - sd->v_data[uv]));
+		}
+	}
+}
+
+static const uint32_t components_list[] = {0x07, 0x04, 0x02, 0x01, 0x05, 0x20, 0x10, 0x40, 0x50, 0x70};
+#define N_COMPONENTS (sizeof(components_list) / sizeof(*components_list))
+
+// Random boundaries of `n` bands in [0, size]. The bands can be empty.
+static void random_bands(struct source *s, uint32_t *bounds, uint32_t n, uint32_t size)
+{
+	bounds[0] = 0;
+	bounds[n] = size;
+	for (uint32_t i = 1; i < n; i++)
+		bounds[i] = next_range(s, bounds[i - 1], size);
+}
+
+#define MAX_BANDS 5
+
+static void test_histogram(const struct frame *f, struct source *s)
+{
+	const struct cm_surface_data sd = frame_surface(f);
+	uint32_t expected[256 * 4], got[256 * 4];
+	size_t n_variants;
+	const struct his_kernel_variant *variants = his_kernel_variants(&n_variants);
+	const his_kernel_func_t best = his_kernel;
+
+	for (size_t c = 0; c < N_COMPONENTS; c++) {
+		const uint32_t components = components_list[c];
+		ref_histogram(expected, &sd, components);
+
+		for (size_t v = 0; v < n_variants; v++) {
+			his_kernel = variants[v].func;
+			memset(got, 0, sizeof(got));
+			his_kernel_accumulate(got, &sd, components, 0, sd.height);
+			compare_u32("histogram", variants[v].name, f, expected, got, 256 * 4);
+
+			// Bands accumulated into the same buffer, as the histogram source does with the partial
+			// buffers.
+			uint32_t bounds[MAX_BANDS + 1];
+			const uint32_t n = next_range(s, 2, MAX_BANDS);
+			random_bands(s, bounds, n, sd.height);
+			memset(got, 0, sizeof(got));
+			for (uint32_t j = 0; j < n; j++)
+				his_kernel_accumulate(got, &sd, components, bounds[j], bounds[j + 1]);
+			compare_u32("histogram-bands", variants[v].name, f, expected, got, 256 * 4);
+		}
+	}
+
+	his_kernel = best;
+}
+
+static void test_waveform(const struct frame *f, struct source *s)
+{
+	const struct cm_surface_data sd = frame_surface(f);
+	const uint32_t out_widths[] = {sd.width, next_range(s, 1, sd.width)};
+	uint8_t *expected = malloc((size_t)MAX_WIDTH * WVS_KERNEL_SIZE * 4);
+	uint8_t *got = malloc((size_t)MAX_WIDTH * WVS_KERNEL_SIZE * 4);
+	if (!expected || !got) {
+		free(expected);
+		free(got);
+		n_failed++;
+		return;
+	}
+
+	for (size_t c = 0; c < N_COMPONENTS; c++) {
+		for (size_t k = 0; k < 2; k++) {
+			const uint32_t out_width = out_widths[k];
+			const size_t size = (size_t)out_width * WVS_KERNEL_SIZE * 4;
+			ref_waveform(expected, &sd, components_list[c], out_width);
+
+			// The kernel overwrites the output, garbage has to disappear.
+			memset(got, 0xA5, size);
+			wvs_kernel_columns(got, &sd, components_list[c], out_width, 0, out_width);
+			compare_u8("waveform", "whole", f, expected, got, size);
+
+			uint32_t bounds[MAX_BANDS + 1];
+			const uint32_t n = next_range(s, 2, MAX_BANDS);
+			random_bands(s, bounds, n, out_width);
+			memset(got, 0xA5, size);
+			for (uint32_t j = 0; j < n; j++)
+				wvs_kernel_columns(got, &sd, components_list[c], out_width, bounds[j], bounds[j + 1]);
+			compare_u8("waveform", "bands", f, expected, got, size);
+		}
+	}
+
+	free(expected);
+	free(got);
+}
+
+static void test_vectorscope(const struct frame *f, struct source *s)
+{
+	const struct cm_surface_data sd = frame_surface(f);
+	static uint8_t expected[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+	static uint8_t got[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+	static uint8_t partial[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+
+	ref_vectorscope(expected, &sd);
+
+	memset(got, 0, sizeof(got));
+	vss_kernel_rows(got, &sd, 0, sd.height);
+	compare_u8("vectorscope", "whole", f, expected, got, sizeof(got));
+
+	uint32_t bounds[MAX_BANDS + 1];
+	const uint32_t n = next_range(s, 2, MAX_BANDS);
+	random_bands(s, bounds, n, sd.height);
+	memset(got, 0, sizeof(got));
+	for (uint32_t j = 0; j < n; j++) {
+		memset(partial, 0, sizeof(partial));
+		vss_kernel_rows(partial, &sd, bounds[j], bounds[j + 1]);
+		vss_kernel_merge(got, partial);
+	}
+	compare_u8("vectorscope", "bands", f, expected, got, sizeof(got));
+}
+
+static void test_rgb_to_yuv(const struct frame *f)
+{
+	const uint32_t w = f->width, h = f->height;
+	const size_t y_size = (size_t)w * h;
+	uint8_t *expected = malloc(y_size * 3);
+	uint8_t *got = malloc(y_size * 3);
+	if (!expected || !got) {
+		free(expected);
+		free(got);
+		n_failed++;
+		return;
+	}
+
+	for (int bt601 = 0; bt601 < 2; bt601++) {
+		cm_rgb_to_yuv_scalar(expected, w, expected + y_size, w * 2, f->rgb, f->linesize, w, h, bt601);
+
+		memset(got, 0xA5, y_size * 3);
+		cm_rgb_to_yuv(got, w, got + y_size, w * 2, f->rgb, f->linesize, w, h, bt601);
+		compare_u8("rgb2yuv", bt601 ? "601" : "709", f, expected, got, y_size * 3);
+
+		// Each plane alone
+		memset(got, 0xA5, y_size * 3);
+		cm_rgb_to_yuv(got, w, NULL, 0, f->rgb, f->linesize, w, h, bt601);
+		cm_rgb_to_yuv(NULL, 0, got + y_size, w * 2, f->rgb, f->linesize, w, h, bt601);
+		compare_u8("rgb2yuv-planes", bt601 ? "601" : "709", f, expected, got, y_size * 3);
+	}
+
+	free(expected);
+	free(got);
+}
+
+static void run_one(struct source *s)
+{
+	struct frame f;
+	if (!frame_init(&f, s)) {
+		frame_free(&f);
+		n_failed++;
+		return;
+	}
+
+	test_histogram(&f, s);
+	test_waveform(&f, s);
+	test_vectorscope(&f, s);
+	test_rgb_to_yuv(&f);
+
+	frame_free(&f);
+}
+
+#ifdef CM_FUZZING
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static bool initialized = false;
+	if (!initialized) {
+		his_kernel_init();
+		initialized = true;
+	}
+
+	struct source s = {.data = data, .size = size, .state = 0x9E3779B97F4A7C15ULL};
+	run_one(&s);
+	if (n_failed)
+		abort();
+	return 0;
+}
+#else
+int main(int argc, char **argv)
+{
+	uint32_t iterations = 200;
+	uint64_t seed = 1;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+			iterations = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = strtoull(argv[++i], NULL, 0);
+		else {
+			fprintf(stderr, "Usage: %s [--iterations N] [--seed S]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	his_kernel_init();
+
+	size_t n_variants;
+	const struct his_kernel_variant *variants = his_kernel_variants(&n_variants);
+	printf("histogram kernels:");
+	for (size_t v = 0; v < n_variants; v++)
+		printf(" %s", variants[v].name);
+	printf("\n");
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		// Each iteration has its own seed so that a failure can be reproduced alone.
+		struct source s = {.state = (seed + i) * 0x9E3779B97F4A7C15ULL | 1};
+		const int n_failed_prev = n_failed;
+		run_one(&s);
+		if (n_failed != n_failed_prev)
+			printf("FAIL iteration %u; reproduce by --seed %llu --iterations 1\n", i,
+			       (unsigned long long)(seed + i));
+	}
+
+	printf("%d checks, %d failed\n", n_checked, n_failed);
+	return n_failed ? 1 : 0;
+}
+#endif
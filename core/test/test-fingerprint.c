@@ -0,0 +1,77 @@
+/*
+ * Test of the fingerprint of images.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+#define WIDTH 67 // not a multiple of the words
+#define HEIGHT 33
+#define LINESIZE 288
+#define ROW_BYTES (WIDTH * 4)
+#define STEP 4
+
+static uint8_t a[LINESIZE * HEIGHT], b[LINESIZE * HEIGHT];
+
+static uint64_t fp(const uint8_t *data)
+{
+	return cm_fingerprint(data, LINESIZE, ROW_BYTES, HEIGHT, STEP);
+}
+
+int main(void)
+{
+	uint32_t seed = 1;
+	for (size_t i = 0; i < sizeof(a); i++) {
+		seed = seed * 1103515245 + 12345;
+		a[i] = (uint8_t)(seed >> 16);
+	}
+	memcpy(b, a, sizeof(a));
+	CHECK(fp(a) == fp(b));
+
+	// The padding at the end of the lines is not read.
+	b[ROW_BYTES] ^= 1;
+	b[LINESIZE - 1] ^= 1;
+	CHECK(fp(a) == fp(b));
+
+	// Every byte of a sampled row is read, including the tail.
+	for (uint32_t y = 0; y < HEIGHT; y += STEP) {
+		for (uint32_t x = 0; x < ROW_BYTES; x += 13) {
+			memcpy(b, a, sizeof(a));
+			b[LINESIZE * y + x] ^= 0x80;
+			CHECK(fp(a) != fp(b));
+		}
+		memcpy(b, a, sizeof(a));
+		b[LINESIZE * y + ROW_BYTES - 1] ^= 1;
+		CHECK(fp(a) != fp(b));
+	}
+
+	// The rows between the samples are not read.
+	memcpy(b, a, sizeof(a));
+	b[LINESIZE * 1 + 5] ^= 1;
+	CHECK(fp(a) == fp(b));
+
+	// Swapping two sampled rows changes the fingerprint.
+	memcpy(b, a, sizeof(a));
+	memcpy(b, a + LINESIZE * STEP, ROW_BYTES);
+	memcpy(b + LINESIZE * STEP, a, ROW_BYTES);
+	CHECK(fp(a) != fp(b));
+
+	// The size is included.
+	CHECK(cm_fingerprint(a, LINESIZE, ROW_BYTES, HEIGHT - 1, STEP) != fp(a));
+	CHECK(cm_fingerprint_mix(fp(a), 1) != cm_fingerprint_mix(fp(a), 2));
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
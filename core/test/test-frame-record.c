@@ -0,0 +1,273 @@
+/*
+ * Round trip test of the frame recording.
+ * Frames are written with various layouts of the planes and read back from the mapped file.
+ *
+ * Usage: test-frame-record path-to-temporary-file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include "synthetic-frame.h"
+#include "frame-record.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+struct test_frame
+{
+	struct synthetic_frame frame;
+	struct cm_surface_data sd; // as given to the writer
+	uint8_t *padded; // RGB with padding at the end of the lines, and separated U and V
+	uint32_t flags;
+};
+
+static bool same_plane(const uint8_t *a, uint32_t a_linesize, uint32_t a_step, const uint8_t *b, uint32_t b_linesize,
+		       uint32_t b_step, uint32_t width_samples, uint32_t sample_size, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width_samples; x++) {
+			if (memcmp(a + (size_t)a_linesize * y + x * a_step, b + (size_t)b_linesize * y + x * b_step,
+				   sample_size))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void check_frame(const struct cm_surface_data *expected, const struct cm_surface_data *got)
+{
+	CHECK(got->width == expected->width);
+	CHECK(got->height == expected->height);
+	CHECK(got->colorspace == expected->colorspace);
+	CHECK(got->timestamp == expected->timestamp);
+	CHECK(!got->rgb_data == !expected->rgb_data);
+	CHECK(!got->y_data == !expected->y_data);
+	CHECK(!got->u_data == !expected->u_data);
+	if (got->width != expected->width || got->height != expected->height)
+		return;
+
+	const uint32_t w = got->width, h = got->height;
+	if (got->rgb_data && expected->rgb_data) {
+		CHECK(((uintptr_t)got->rgb_data % CM_FRAME_ALIGN) == 0);
+		CHECK(same_plane(got->rgb_data, got->linesize, 4, expected->rgb_data, expected->linesize, 4, w, 4, h));
+	}
+	if (got->y_data && expected->y_data)
+		CHECK(same_plane(got->y_data, got->y_linesize, 1, expected->y_data, expected->y_linesize, 1, w, 1, h));
+	if (got->u_data && expected->u_data) {
+		CHECK(got->uv_shift_x == expected->uv_shift_x);
+		CHECK(got->uv_shift_y == expected->uv_shift_y);
+		const uint32_t uw = cm_surface_uv_width(expected), uh = cm_surface_uv_height(expected);
+		CHECK(same_plane(got->u_data, got->uv_linesize, got->uv_step, expected->u_data, expected->uv_linesize,
+				 expected->uv_step, uw, 1, uh));
+		CHECK(same_plane(got->v_data, got->uv_linesize, got->uv_step, expected->v_data, expected->uv_linesize,
+				 expected->uv_step, uw, 1, uh));
+	}
+}
+
+static bool test_frame_init(struct test_frame *t, const char *pattern, uint32_t width, uint32_t height, int variant)
+{
+	memset(t, 0, sizeof(*t));
+	if (!synthetic_frame_init(&t->frame, pattern, width, height))
+		return false;
+
+	t->sd = t->frame.sd;
+	t->sd.timestamp = 1000000000ULL + 16666667ULL * (uint64_t)variant;
+
+	switch (variant % 5) {
+	case 0: // as read back
+		break;
+	case 1: // RGB only, having padding like a stage surface
+	{
+		const uint32_t linesize = width * 4 + 60;
+		t->padded = calloc(1, (size_t)linesize * height);
+		if (!t->padded)
+			return false;
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(t->padded + (size_t)linesize * y, t->frame.rgb_data + (size_t)width * 4 * y, width * 4);
+		t->sd.rgb_data = t->padded;
+		t->sd.linesize = linesize;
+		t->sd.y_data = t->sd.u_data = t->sd.v_data = NULL;
+		break;
+	}
+	case 2: // YUV only, U and V are not interleaved
+	{
+		const uint32_t linesize = width + 3;
+		t->padded = calloc(2, (size_t)linesize * height);
+		if (!t->padded)
+			return false;
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				t->padded[(size_t)linesize * y + x] = t->frame.uv_data[(size_t)width * 2 * y + x * 2];
+				t->padded[(size_t)linesize * (height + y) + x] =
+					t->frame.uv_data[(size_t)width * 2 * y + x * 2 + 1];
+			}
+		}
+		t->sd.rgb_data = NULL;
+		t->sd.u_data = t->padded;
+		t->sd.v_data = t->padded + (size_t)linesize * height;
+		t->sd.uv_linesize = linesize;
+		t->sd.uv_step = 1;
+		break;
+	}
+	case 3: // Y only
+		t->sd.rgb_data = NULL;
+		t->sd.u_data = t->sd.v_data = NULL;
+		t->sd.colorspace = 1;
+		break;
+	case 4: // YUV 4:2:0, taking every other sample of the interleaved UV
+		t->sd.rgb_data = NULL;
+		t->sd.uv_linesize = width * 2 * 2;
+		t->sd.uv_step = 4;
+		t->sd.uv_shift_x = 1;
+		t->sd.uv_shift_y = 1;
+		break;
+	}
+	return true;
+}
+
+static void test_frame_free(struct test_frame *t)
+{
+	synthetic_frame_free(&t->frame);
+	free(t->padded);
+}
+
+#define N_FRAMES 10
+
+static void check_file(const char *path, const struct test_frame *frames, uint32_t n)
+{
+	struct cm_frame_reader *r = cm_frame_reader_open(path);
+	CHECK(r != NULL);
+	if (!r)
+		return;
+
+	CHECK(cm_frame_reader_count(r) == n);
+	for (uint32_t i = 0; i < n && i < cm_frame_reader_count(r); i++) {
+		struct cm_surface_data sd;
+		CHECK(cm_frame_reader_get(r, i, &sd));
+		check_frame(&frames[i].sd, &sd);
+	}
+
+	struct cm_surface_data sd;
+	CHECK(!cm_frame_reader_get(r, n, &sd));
+	cm_frame_reader_close(r);
+}
+
+// Clears the index in the header as if the writer was not closed.
+static bool drop_index(const char *path)
+{
+	FILE *fp = fopen(path, "r+b");
+	if (!fp)
+		return false;
+	struct cm_frame_file_header header;
+	bool ret = fread(&header, sizeof(header), 1, fp) == 1;
+	header.n_frames = 0;
+	header.index_offset = 0;
+	ret = ret && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+	fclose(fp);
+	return ret;
+}
+
+// Overwrites a field of the first frame record.
+static bool patch_first_record(const char *path, size_t field_offset, uint32_t value)
+{
+	FILE *fp = fopen(path, "r+b");
+	if (!fp)
+		return false;
+	const long offset = (long)(((sizeof(struct cm_frame_file_header) + CM_FRAME_ALIGN - 1) / CM_FRAME_ALIGN) *
+				   CM_FRAME_ALIGN + field_offset);
+	bool ret = fseek(fp, offset, SEEK_SET) == 0 && fwrite(&value, sizeof(value), 1, fp) == 1;
+	fclose(fp);
+	return ret;
+}
+
+// A record whose linesize does not match the width is rejected instead of being read past the plane.
+static void test_malformed(const char *path, const struct test_frame *frame)
+{
+	static const struct
+	{
+		size_t offset;
+		uint32_t value;
+	} fields[] = {
+		{offsetof(struct cm_frame_record, linesize), 0x10000000},
+		{offsetof(struct cm_frame_record, y_linesize), 0x10000000},
+		{offsetof(struct cm_frame_record, uv_linesize), 0x10000000},
+		{offsetof(struct cm_frame_record, linesize), 4},
+	};
+
+	for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+		struct cm_frame_writer *w = cm_frame_writer_open(path);
+		CHECK(w != NULL);
+		if (!w)
+			return;
+		CHECK(cm_frame_writer_write(w, &frame->sd));
+		cm_frame_writer_close(w);
+		CHECK(patch_first_record(path, fields[i].offset, fields[i].value));
+
+		struct cm_frame_reader *r = cm_frame_reader_open(path);
+		if (r) {
+			struct cm_surface_data sd;
+			CHECK(cm_frame_reader_count(r) == 0);
+			CHECK(!cm_frame_reader_get(r, 0, &sd));
+			cm_frame_reader_close(r);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s path-to-temporary-file\n", argv[0]);
+		return 2;
+	}
+	const char *path = argv[1];
+
+	struct test_frame frames[N_FRAMES];
+	for (int i = 0; i < N_FRAMES; i++) {
+		const uint32_t width = i & 1 ? 97 : 320;
+		const uint32_t height = i & 1 ? 61 : 180;
+		if (!test_frame_init(&frames[i], synthetic_patterns[i % synthetic_patterns_count], width, height, i)) {
+			fprintf(stderr, "Error: failed to create frame %d\n", i);
+			return 1;
+		}
+	}
+
+	struct cm_frame_writer *w = cm_frame_writer_open(path);
+	CHECK(w != NULL);
+	if (!w)
+		return 1;
+	for (int i = 0; i < N_FRAMES; i++)
+		CHECK(cm_frame_writer_write(w, &frames[i].sd));
+	cm_frame_writer_close(w);
+
+	check_file(path, frames, N_FRAMES);
+
+	CHECK(drop_index(path));
+	check_file(path, frames, N_FRAMES);
+
+	// An empty recording is valid.
+	w = cm_frame_writer_open(path);
+	CHECK(w != NULL);
+	cm_frame_writer_close(w);
+	check_file(path, frames, 0);
+
+	// Frame 0 has all the planes.
+	test_malformed(path, &frames[0]);
+
+	remove(path);
+	for (int i = 0; i < N_FRAMES; i++)
+		test_frame_free(&frames[i]);
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
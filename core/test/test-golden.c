@@ -0,0 +1,316 @@
+/*
+ * Golden-output test of the kernels.
+ * Each kernel runs on the synthetic frames and a hash of its output is compared with `golden.txt`.
+ * Variants of a kernel, and the same work split into bands, have to match the same hash.
+ *
+ * Usage: test-golden golden.txt
+ *        test-golden --update golden.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "synthetic-frame.h"
+#include "histogram-kernel.h"
+#include "waveform-kernel.h"
+#include "vectorscope-kernel.h"
+#include "yuv-convert.h"
+
+#define MAX_GOLDEN 1024
+#define MAX_NAME 96
+#define MAX_SUFFIX 48 // pattern and size, appended to the names
+
+static struct
+{
+	char names[MAX_GOLDEN][MAX_NAME];
+	uint64_t hashes[MAX_GOLDEN];
+	int n;
+	FILE *update;
+	int n_checked;
+	int n_failed;
+} golden;
+
+struct test_size
+{
+	uint32_t width, height;
+};
+
+// An odd size leaves the tails of the vectorized loops and a partial tile of the waveform.
+static const struct test_size sizes[] = {
+	{320, 180},
+	{97, 61},
+};
+
+struct test_components
+{
+	const char *name;
+	uint32_t components;
+};
+
+static const struct test_components components_list[] = {
+	{"rgb", 0x07}, {"r", 0x04}, {"gb", 0x03}, {"y", 0x20}, {"uv", 0x50}, {"yuv", 0x70},
+};
+
+static uint64_t fnv1a(uint64_t h, const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		h ^= data[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+#define FNV1A_INIT 0xcbf29ce484222325ULL
+
+// Hashes the values in little endian so that the hash does not depend on the byte order of the host.
+static uint64_t fnv1a_u32(uint64_t h, const uint32_t *data, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t b[4] = {(uint8_t)data[i], (uint8_t)(data[i] >> 8), (uint8_t)(data[i] >> 16),
+				      (uint8_t)(data[i] >> 24)};
+		h = fnv1a(h, b, 4);
+	}
+	return h;
+}
+
+static bool golden_load(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot open '%s'\n", path);
+		return false;
+	}
+
+	char name[MAX_NAME];
+	unsigned long long hash;
+	while (golden.n < MAX_GOLDEN && fscanf(fp, "%95s %llx", name, &hash) == 2) {
+		snprintf(golden.names[golden.n], MAX_NAME, "%s", name);
+		golden.hashes[golden.n] = hash;
+		golden.n++;
+	}
+
+	fclose(fp);
+	return true;
+}
+
+static const uint64_t *golden_find(const char *name)
+{
+	for (int i = 0; i < golden.n; i++) {
+		if (!strcmp(golden.names[i], name))
+			return &golden.hashes[i];
+	}
+	return NULL;
+}
+
+// `variant` tells which implementation produced `hash`; all variants of `name` share one golden hash.
+static void check(const char *name, const char *variant, uint64_t hash)
+{
+	golden.n_checked++;
+
+	if (golden.update) {
+		if (!golden_find(name)) {
+			if (golden.n >= MAX_GOLDEN) {
+				fprintf(stderr, "Error: too many golden entries\n");
+				exit(1);
+			}
+			snprintf(golden.names[golden.n], MAX_NAME, "%s", name);
+			golden.hashes[golden.n++] = hash;
+			fprintf(golden.update, "%s %016llx\n", name, (unsigned long long)hash);
+			return;
+		}
+	}
+
+	const uint64_t *expected = golden_find(name);
+	if (!expected) {
+		printf("FAIL %s (%s): no golden entry\n", name, variant);
+		golden.n_failed++;
+	} else if (*expected != hash) {
+		printf("FAIL %s (%s): expected %016llx, got %016llx\n", name, variant, (unsigned long long)*expected,
+		       (unsigned long long)hash);
+		golden.n_failed++;
+	}
+}
+
+static void test_histogram(const struct synthetic_frame *frame, const char *suffix)
+{
+	static const struct
+	{
+		const char *name;
+		his_kernel_func_t func;
+	} variants[] = {
+		{"scalar", his_kernel_scalar},
+		{"banked", his_kernel_banked},
+		{"best", NULL},
+	};
+	const his_kernel_func_t best = his_kernel;
+	const struct cm_surface_data *sd = &frame->sd;
+	uint32_t dbuf[256 * 4];
+	char name[MAX_NAME];
+
+	for (size_t c = 0; c < sizeof(components_list) / sizeof(*components_list); c++) {
+		const uint32_t components = components_list[c].components;
+		snprintf(name, sizeof(name), "histogram/%s/%s", components_list[c].name, suffix);
+
+		for (size_t v = 0; v < sizeof(variants) / sizeof(*variants); v++) {
+			his_kernel = variants[v].func ? variants[v].func : best;
+			memset(dbuf, 0, sizeof(dbuf));
+			his_kernel_accumulate(dbuf, sd, components, 0, sd->height);
+			check(name, variants[v].name, fnv1a_u32(FNV1A_INIT, dbuf, 256 * 4));
+		}
+		his_kernel = best;
+
+		// Same as the bands summed by the histogram source
+		uint32_t partial[256 * 4];
+		memset(dbuf, 0, sizeof(dbuf));
+		for (uint32_t j = 0, n = 3; j < n; j++) {
+			memset(partial, 0, sizeof(partial));
+			his_kernel_accumulate(partial, sd, components, sd->height * j / n, sd->height * (j + 1) / n);
+			for (int i = 0; i < 256 * 4; i++)
+				dbuf[i] += partial[i];
+		}
+		check(name, "bands", fnv1a_u32(FNV1A_INIT, dbuf, 256 * 4));
+
+		// Normalization; the linear scale only converts integers to float so that the result is exact.
+		uint32_t hi_max[3];
+		float flt[256 * 4];
+		snprintf(name, sizeof(name), "histogram-max/%s/%s", components_list[c].name, suffix);
+		his_kernel_calculate_max(hi_max, dbuf, components);
+		his_kernel_to_float(flt, dbuf, hi_max, components, false);
+		uint32_t flt_bits[256 * 4];
+		memcpy(flt_bits, flt, sizeof(flt));
+		uint64_t h = fnv1a_u32(FNV1A_INIT, hi_max, 3);
+		check(name, "linear", fnv1a_u32(h, flt_bits, 256 * 4));
+	}
+}
+
+static void test_waveform(const struct synthetic_frame *frame, const char *suffix)
+{
+	const struct cm_surface_data *sd = &frame->sd;
+	const uint32_t columns_list[] = {0, 64};
+	char name[MAX_NAME];
+
+	for (size_t c = 0; c < sizeof(components_list) / sizeof(*components_list); c++) {
+		for (size_t k = 0; k < sizeof(columns_list) / sizeof(*columns_list); k++) {
+			const uint32_t out_width = columns_list[k] ? columns_list[k] : sd->width;
+			const size_t size = (size_t)out_width * WVS_KERNEL_SIZE * 4;
+			uint8_t *dbuf = malloc(size);
+			snprintf(name, sizeof(name), "waveform/%s/%u/%s", components_list[c].name, columns_list[k],
+				 suffix);
+
+			memset(dbuf, 0xCC, size);
+			wvs_kernel_columns(dbuf, sd, components_list[c].components, out_width, 0, out_width);
+			check(name, "whole", fnv1a(FNV1A_INIT, dbuf, size));
+
+			// Bands are not aligned to the tiles on purpose.
+			memset(dbuf, 0xCC, size);
+			for (uint32_t j = 0, n = 3; j < n; j++)
+				wvs_kernel_columns(dbuf, sd, components_list[c].components, out_width,
+						   out_width * j / n, out_width * (j + 1) / n);
+			check(name, "bands", fnv1a(FNV1A_INIT, dbuf, size));
+
+			free(dbuf);
+		}
+	}
+}
+
+static void test_vectorscope(const struct synthetic_frame *frame, const char *suffix)
+{
+	const struct cm_surface_data *sd = &frame->sd;
+	static uint8_t dbuf[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+	static uint8_t partial[VSS_KERNEL_SIZE * VSS_KERNEL_SIZE];
+	char name[MAX_NAME];
+	snprintf(name, sizeof(name), "vectorscope/%s", suffix);
+
+	memset(dbuf, 0, sizeof(dbuf));
+	vss_kernel_rows(dbuf, sd, 0, sd->height);
+	check(name, "whole", fnv1a(FNV1A_INIT, dbuf, sizeof(dbuf)));
+
+	memset(dbuf, 0, sizeof(dbuf));
+	for (uint32_t j = 0, n = 3; j < n; j++) {
+		memset(partial, 0, sizeof(partial));
+		vss_kernel_rows(partial, sd, sd->height * j / n, sd->height * (j + 1) / n);
+		vss_kernel_merge(dbuf, partial);
+	}
+	check(name, "bands", fnv1a(FNV1A_INIT, dbuf, sizeof(dbuf)));
+}
+
+static void test_rgb_to_yuv(const struct synthetic_frame *frame, const char *suffix)
+{
+	const struct cm_surface_data *sd = &frame->sd;
+	const size_t y_size = (size_t)sd->width * sd->height;
+	uint8_t *buf = malloc(y_size * 3);
+	char name[MAX_NAME];
+
+	for (int bt601 = 0; bt601 < 2; bt601++) {
+		snprintf(name, sizeof(name), "rgb2yuv/%s/%s", bt601 ? "601" : "709", suffix);
+
+		cm_rgb_to_yuv_scalar(buf, sd->width, buf + y_size, sd->width * 2, sd->rgb_data, sd->linesize,
+				     sd->width, sd->height, bt601);
+		check(name, "scalar", fnv1a(FNV1A_INIT, buf, y_size * 3));
+
+		cm_rgb_to_yuv(buf, sd->width, buf + y_size, sd->width * 2, sd->rgb_data, sd->linesize, sd->width,
+			      sd->height, bt601);
+		check(name, "simd", fnv1a(FNV1A_INIT, buf, y_size * 3));
+	}
+
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	bool update = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--update"))
+			update = true;
+		else
+			path = argv[i];
+	}
+	if (!path) {
+		fprintf(stderr, "Usage: %s [--update] golden.txt\n", argv[0]);
+		return 2;
+	}
+
+	if (update) {
+		golden.update = fopen(path, "w");
+		if (!golden.update) {
+			fprintf(stderr, "Error: cannot open '%s'\n", path);
+			return 1;
+		}
+	} else if (!golden_load(path)) {
+		return 1;
+	}
+
+	his_kernel_init();
+	printf("histogram kernel: %s\n", his_kernel_name());
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		for (uint32_t p = 0; p < synthetic_patterns_count; p++) {
+			struct synthetic_frame frame;
+			char suffix[MAX_SUFFIX];
+			snprintf(suffix, sizeof(suffix), "%s/%ux%u", synthetic_patterns[p], sizes[s].width,
+				 sizes[s].height);
+
+			if (!synthetic_frame_init(&frame, synthetic_patterns[p], sizes[s].width, sizes[s].height)) {
+				fprintf(stderr, "Error: failed to create frame %s\n", suffix);
+				synthetic_frame_free(&frame);
+				return 1;
+			}
+
+			test_histogram(&frame, suffix);
+			test_waveform(&frame, suffix);
+			test_vectorscope(&frame, suffix);
+			test_rgb_to_yuv(&frame, suffix);
+
+			synthetic_frame_free(&frame);
+		}
+	}
+
+	if (golden.update)
+		fclose(golden.update);
+
+	printf("%d checks, %d failed\n", golden.n_checked, golden.n_failed);
+	return golden.n_failed ? 1 : 0;
+}
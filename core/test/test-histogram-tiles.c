@@ -0,0 +1,126 @@
+/*
+ * Test of the incremental histogram over tiles.
+ * After each change of the frame, the total has to be same as the histogram accumulated from scratch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synthetic-frame.h"
+#include "histogram-kernel.h"
+#include "histogram-tiles.h"
+#include "yuv-convert.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+#define WIDTH 200 // not a multiple of the tile size
+#define HEIGHT 150
+
+static uint32_t expected[HIS_TILES_BINS];
+static uint32_t delta[2][HIS_TILES_BINS];
+
+// Updates the tiles in two bands as the plugin does with the worker threads.
+static uint32_t update(struct his_tiles *t, const struct cm_surface_data *sd, uint32_t components)
+{
+	const uint32_t n = his_tiles_begin(t, sd, components);
+	CHECK(n == (sd->height + HIS_TILE_SIZE - 1) / HIS_TILE_SIZE);
+
+	memset(delta, 0, sizeof(delta));
+	uint32_t n_changed = his_tiles_update(t, delta[0], sd, 0, n / 2);
+	n_changed += his_tiles_update(t, delta[1], sd, n / 2, n);
+	his_tiles_commit(t, delta[0]);
+	his_tiles_commit(t, delta[1]);
+	return n_changed;
+}
+
+static bool same_as_scratch(const struct his_tiles *t, const struct cm_surface_data *sd, uint32_t components)
+{
+	memset(expected, 0, sizeof(expected));
+	his_kernel_accumulate(expected, sd, components, 0, sd->height);
+	return memcmp(expected, t->total, sizeof(expected)) == 0;
+}
+
+static void reconvert_yuv(struct synthetic_frame *f)
+{
+	cm_rgb_to_yuv_scalar(f->y_data, f->sd.y_linesize, f->uv_data, f->sd.uv_linesize, f->rgb_data, f->sd.linesize,
+			     f->sd.width, f->sd.height, false);
+}
+
+static void paint(struct synthetic_frame *f, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, uint8_t v)
+{
+	for (uint32_t y = y0; y < y0 + h; y++) {
+		for (uint32_t x = x0; x < x0 + w; x++) {
+			uint8_t *p = f->rgb_data + f->sd.linesize * y + x * 4;
+			p[0] = v;
+			p[1] = (uint8_t)(255 - v);
+			p[2] = (uint8_t)(v ^ 0x55);
+			p[3] = 255;
+		}
+	}
+	reconvert_yuv(f);
+}
+
+static void test_components(uint32_t components)
+{
+	struct synthetic_frame f;
+	struct his_tiles t;
+	const uint32_t n_tiles =
+		((WIDTH + HIS_TILE_SIZE - 1) / HIS_TILE_SIZE) * ((HEIGHT + HIS_TILE_SIZE - 1) / HIS_TILE_SIZE);
+
+	his_tiles_init(&t);
+	CHECK(synthetic_frame_init(&f, "alpha-holes", WIDTH, HEIGHT));
+
+	CHECK(update(&t, &f.sd, components) == n_tiles);
+	CHECK(same_as_scratch(&t, &f.sd, components));
+
+	// Static frame
+	CHECK(update(&t, &f.sd, components) == 0);
+	CHECK(same_as_scratch(&t, &f.sd, components));
+
+	// A lower third inside one row of tiles
+	paint(&f, 10, 70, 150, 20, 40);
+	CHECK(update(&t, &f.sd, components) == 3);
+	CHECK(same_as_scratch(&t, &f.sd, components));
+
+	// One pixel at the last partial tile
+	paint(&f, WIDTH - 1, HEIGHT - 1, 1, 1, 200);
+	CHECK(update(&t, &f.sd, components) == 1);
+	CHECK(same_as_scratch(&t, &f.sd, components));
+
+	// Invalidated tiles are accumulated again without double counting.
+	his_tiles_invalidate(&t);
+	CHECK(update(&t, &f.sd, components) == n_tiles);
+	CHECK(same_as_scratch(&t, &f.sd, components));
+
+	// Another size resets the tiles.
+	struct cm_surface_data small = f.sd;
+	small.width = WIDTH / 2;
+	small.height = HEIGHT / 2;
+	update(&t, &small, components);
+	CHECK(same_as_scratch(&t, &small, components));
+
+	synthetic_frame_free(&f);
+	his_tiles_free(&t);
+}
+
+int main(void)
+{
+	his_kernel_init();
+
+	test_components(0x07); // RGB
+	test_components(0x02); // G only
+	test_components(0x20); // Y
+	test_components(0x50); // UV
+	test_components(0x70); // YUV
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Test of the accumulator of durations.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "timing-stats.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+// The reported percentile is not below the exact one and within the resolution of the buckets.
+static bool near_above(uint64_t got, uint64_t exact)
+{
+	return got >= exact && got <= exact + exact / 8 + 1;
+}
+
+static struct cm_timing t, u;
+
+int main(void)
+{
+	cm_timing_reset(&t);
+	CHECK(cm_timing_avg(&t) == 0);
+	CHECK(cm_timing_percentile(&t, 99.0) == 0);
+
+	for (uint64_t v = 1; v <= 1000; v++)
+		cm_timing_add(&t, v * 1000);
+	CHECK(t.count == 1000);
+	CHECK(t.min == 1000);
+	CHECK(t.max == 1000000);
+	CHECK(cm_timing_avg(&t) == 500500);
+	CHECK(near_above(cm_timing_percentile(&t, 50.0), 500000));
+	CHECK(near_above(cm_timing_percentile(&t, 99.0), 990000));
+	CHECK(cm_timing_percentile(&t, 100.0) == 1000000);
+
+	// Small values are exact.
+	cm_timing_reset(&u);
+	for (uint64_t v = 0; v < 100; v++)
+		cm_timing_add(&u, v % 10);
+	CHECK(cm_timing_percentile(&u, 10.0) == 0);
+	CHECK(cm_timing_percentile(&u, 95.0) == 9);
+
+	// Very long durations go to the last bucket.
+	cm_timing_reset(&u);
+	cm_timing_add(&u, UINT64_MAX / 2);
+	CHECK(cm_timing_percentile(&u, 99.0) <= UINT64_MAX / 2);
+
+	cm_timing_reset(&u);
+	for (uint64_t v = 0; v < 1000; v++)
+		cm_timing_add(&u, 5000000);
+	cm_timing_merge(&u, &t);
+	CHECK(u.count == 2000);
+	CHECK(u.min == 1000);
+	CHECK(u.max == 5000000);
+	CHECK(near_above(cm_timing_percentile(&u, 25.0), 500000));
+	CHECK(cm_timing_percentile(&u, 99.0) == 5000000);
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Test of the trace ring buffer and the JSON output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace-buffer.h"
+
+static int n_failed;
+
+#define CHECK(cond)                                                          \
+	do {                                                                 \
+		if (!(cond)) {                                               \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			n_failed++;                                          \
+		}                                                            \
+	} while (0)
+
+static char *write_to_string(struct cm_trace_ring *const *rings, size_t n_rings, uint64_t ts_origin)
+{
+	FILE *fp = tmpfile();
+	if (!fp)
+		return NULL;
+
+	CHECK(cm_trace_write_json(fp, rings, n_rings, ts_origin));
+	long size = ftell(fp);
+	rewind(fp);
+	char *buf = calloc(1, size + 1);
+	if (fread(buf, 1, size, fp) != (size_t)size)
+		buf[0] = 0;
+	fclose(fp);
+	return buf;
+}
+
+static int count(const char *s, const char *needle)
+{
+	int n = 0;
+	for (const char *p = strstr(s, needle); p; p = strstr(p + 1, needle))
+		n++;
+	return n;
+}
+
+int main(void)
+{
+	struct cm_trace_ring a, b;
+	CHECK(!cm_trace_ring_init(&a, 0, 1, "none"));
+	CHECK(cm_trace_ring_init(&a, 8, 1, "graphics"));
+	CHECK(cm_trace_ring_init(&b, 4, 2, "pipe \"Histogram\""));
+
+	cm_trace_ring_push(&a, "render", CM_TRACE_BEGIN, 1000, 0);
+	cm_trace_ring_push(&a, "ready", CM_TRACE_INSTANT, 1500, 2);
+	cm_trace_ring_push(&a, "render", CM_TRACE_END, 2500, 0);
+
+	// Wraps around; the first begin is overwritten so that its end is not written.
+	cm_trace_ring_push(&b, "callback", CM_TRACE_BEGIN, 2000, 0);
+	cm_trace_ring_push(&b, "band", CM_TRACE_BEGIN, 2100, 0);
+	cm_trace_ring_push(&b, "band", CM_TRACE_END, 2200, 0);
+	cm_trace_ring_push(&b, "band", CM_TRACE_BEGIN, 2300, 0);
+	cm_trace_ring_push(&b, "band", CM_TRACE_END, 2400, 0);
+	cm_trace_ring_push(&b, "callback", CM_TRACE_END, 2600, 0);
+	CHECK(b.n_pushed == 6);
+
+	struct cm_trace_ring *rings[] = {&a, &b};
+	char *json = write_to_string(rings, 2, 1000);
+	CHECK(json);
+	if (json) {
+		CHECK(strncmp(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0);
+		CHECK(strstr(json, "\"args\":{\"name\":\"graphics\"}"));
+		CHECK(strstr(json, "\"args\":{\"name\":\"pipe \\\"Histogram\\\"\"}"));
+		CHECK(strstr(json, "{\"ph\":\"B\",\"pid\":1,\"tid\":1,\"ts\":0.000,\"name\":\"render\"}"));
+		CHECK(strstr(json, "{\"ph\":\"E\",\"pid\":1,\"tid\":1,\"ts\":1.500,\"name\":\"render\"}"));
+		CHECK(strstr(json, "\"ts\":0.500,\"name\":\"ready\",\"s\":\"t\",\"args\":{\"v\":2}"));
+		CHECK(count(json, "\"name\":\"band\"") == 2);
+		CHECK(count(json, "\"name\":\"callback\"") == 0);
+		CHECK(strstr(json, "\n]}\n"));
+		free(json);
+	}
+
+	cm_trace_ring_free(&a);
+	cm_trace_ring_free(&b);
+
+	printf("%d failed\n", n_failed);
+	return n_failed ? 1 : 0;
+}
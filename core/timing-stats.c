@@ -0,0 +1,110 @@
+#include <string.h>
+#include "timing-stats.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define SUB_COUNT (1 << CM_TIMING_SUB_BITS)
+
+// `v` must not be 0.
+static inline int msb64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 63 - __builtin_clzll(v);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long n;
+	_BitScanReverse64(&n, v);
+	return (int)n;
+#else
+	int n = 0;
+	while (v >>= 1)
+		n++;
+	return n;
+#endif
+}
+
+/*
+ * Values below SUB_COUNT have their own bucket.
+ * Above that, a power of two [2^e, 2^(e+1)) is split into SUB_COUNT buckets.
+ */
+static inline uint32_t bucket_of(uint64_t v)
+{
+	if (v < SUB_COUNT)
+		return (uint32_t)v;
+
+	const int e = msb64(v);
+	if (e >= CM_TIMING_MAX_BITS)
+		return CM_TIMING_BUCKETS - 1;
+	const uint32_t sub = (uint32_t)(v >> (e - CM_TIMING_SUB_BITS)) & (SUB_COUNT - 1);
+	return ((uint32_t)(e - CM_TIMING_SUB_BITS + 1) << CM_TIMING_SUB_BITS) + sub;
+}
+
+// Returns the largest value counted in the bucket `b`.
+static inline uint64_t bucket_upper(uint32_t b)
+{
+	if (b < SUB_COUNT)
+		return b;
+
+	const int e = (int)(b >> CM_TIMING_SUB_BITS) + CM_TIMING_SUB_BITS - 1;
+	const uint64_t sub = b & (SUB_COUNT - 1);
+	return ((SUB_COUNT + sub + 1) << (e - CM_TIMING_SUB_BITS)) - 1;
+}
+
+void cm_timing_reset(struct cm_timing *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+void cm_timing_add(struct cm_timing *t, uint64_t value)
+{
+	if (!t->count || value < t->min)
+		t->min = value;
+	if (value > t->max)
+		t->max = value;
+	t->count++;
+	t->sum += value;
+	t->buckets[bucket_of(value)]++;
+}
+
+void cm_timing_merge(struct cm_timing *dst, const struct cm_timing *src)
+{
+	if (!src->count)
+		return;
+
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	for (int i = 0; i < CM_TIMING_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t cm_timing_avg(const struct cm_timing *t)
+{
+	return t->count ? t->sum / t->count : 0;
+}
+
+uint64_t cm_timing_percentile(const struct cm_timing *t, double p)
+{
+	if (!t->count)
+		return 0;
+
+	// Rank of the sample, counting from 1
+	uint64_t rank = (uint64_t)(t->count * p / 100.0 + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	if (rank > t->count)
+		rank = t->count;
+
+	uint64_t n = 0;
+	for (uint32_t b = 0; b < CM_TIMING_BUCKETS; b++) {
+		n += t->buckets[b];
+		if (n >= rank) {
+			const uint64_t v = bucket_upper(b);
+			return v < t->max ? v : t->max;
+		}
+	}
+	return t->max;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Accumulator of durations to report min, average, max, and percentiles.
+ * Durations are counted in buckets growing logarithmically with 8 buckets in each power of two,
+ * so that a percentile is reported with an error of 12.5% at most and adding a sample costs a few
+ * instructions. Durations beyond 2^CM_TIMING_MAX_BITS are counted in the last bucket.
+ * This file does not depend on libobs.
+ */
+
+#define CM_TIMING_SUB_BITS 3
+#define CM_TIMING_MAX_BITS 40 // about 18 minutes in nanoseconds
+#define CM_TIMING_BUCKETS ((CM_TIMING_MAX_BITS - CM_TIMING_SUB_BITS + 1) << CM_TIMING_SUB_BITS)
+
+struct cm_timing
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min, max;
+	uint32_t buckets[CM_TIMING_BUCKETS];
+};
+
+void cm_timing_reset(struct cm_timing *t);
+void cm_timing_add(struct cm_timing *t, uint64_t value);
+void cm_timing_merge(struct cm_timing *dst, const struct cm_timing *src);
+
+// Returns 0 if no sample was added.
+uint64_t cm_timing_avg(const struct cm_timing *t);
+
+/*
+ * Returns the upper bound of the bucket containing the `p`-th percentile, 0 < p <= 100,
+ * clamped to the max. Returns 0 if no sample was added.
+ */
+uint64_t cm_timing_percentile(const struct cm_timing *t, double p);
+
+#ifdef __cplusplus
+}
+#endif
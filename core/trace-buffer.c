@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "trace-buffer.h"
+
+bool cm_trace_ring_init(struct cm_trace_ring *ring, uint32_t capacity, uint32_t tid, const char *thread_name)
+{
+	memset(ring, 0, sizeof(*ring));
+	if (!capacity)
+		return false;
+
+	ring->events = calloc(capacity, sizeof(struct cm_trace_event));
+	if (!ring->events)
+		return false;
+
+	ring->capacity = capacity;
+	ring->tid = tid;
+	if (thread_name) {
+		strncpy(ring->thread_name, thread_name, CM_TRACE_THREAD_NAME_SIZE - 1);
+		ring->thread_name[CM_TRACE_THREAD_NAME_SIZE - 1] = 0;
+	}
+	return true;
+}
+
+void cm_trace_ring_free(struct cm_trace_ring *ring)
+{
+	free(ring->events);
+	ring->events = NULL;
+	ring->capacity = 0;
+	ring->n_pushed = 0;
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; s++) {
+		const unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void write_ts(FILE *fp, uint64_t ts, uint64_t ts_origin)
+{
+	// microseconds with 3 decimals
+	const uint64_t ns = ts > ts_origin ? ts - ts_origin : 0;
+	fprintf(fp, "%llu.%03u", (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+}
+
+bool cm_trace_write_json(FILE *fp, struct cm_trace_ring *const *rings, size_t n_rings, uint64_t ts_origin)
+{
+	bool first = true;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+
+	for (size_t i = 0; i < n_rings; i++) {
+		const struct cm_trace_ring *ring = rings[i];
+
+		if (!first)
+			fputs(",\n", fp);
+		first = false;
+		fprintf(fp, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+			ring->tid);
+		write_string(fp, ring->thread_name[0] ? ring->thread_name : "thread");
+		fputs("}}", fp);
+
+		const uint64_t n = ring->n_pushed;
+		const uint64_t i0 = n > ring->capacity ? n - ring->capacity : 0;
+		uint64_t depth = 0;
+		for (uint64_t j = i0; j < n; j++) {
+			const struct cm_trace_event *e = &ring->events[j % ring->capacity];
+			if (!e->name)
+				continue;
+
+			if (e->phase == CM_TRACE_BEGIN) {
+				depth++;
+			} else if (e->phase == CM_TRACE_END) {
+				if (!depth)
+					continue;
+				depth--;
+			}
+
+			fprintf(fp, ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":", e->phase, ring->tid);
+			write_ts(fp, e->ts, ts_origin);
+			fputs(",\"name\":", fp);
+			write_string(fp, e->name);
+			if (e->phase == CM_TRACE_INSTANT)
+				fprintf(fp, ",\"s\":\"t\",\"args\":{\"v\":%lld}", (long long)e->arg);
+			fputs("}", fp);
+		}
+	}
+
+	fputs("\n]}\n", fp);
+
+	return !ferror(fp);
+}
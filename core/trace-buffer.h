@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ring buffer of trace events of one thread, written as the JSON format of the Chrome tracing,
+ * which can be opened by Perfetto or chrome://tracing.
+ * Only the owning thread pushes events so that pushing costs a few stores without any lock.
+ * When the ring is full, the oldest events are overwritten.
+ * This file does not depend on libobs.
+ */
+
+#define CM_TRACE_BEGIN 'B'
+#define CM_TRACE_END 'E'
+#define CM_TRACE_INSTANT 'i'
+
+#define CM_TRACE_THREAD_NAME_SIZE 64
+
+struct cm_trace_event
+{
+	const char *name; // must be a static string
+	uint64_t ts; // ns
+	int64_t arg;
+	char phase; // CM_TRACE_*
+};
+
+struct cm_trace_ring
+{
+	struct cm_trace_event *events;
+	uint32_t capacity;
+	uint64_t n_pushed;
+	uint32_t tid;
+	char thread_name[CM_TRACE_THREAD_NAME_SIZE];
+};
+
+bool cm_trace_ring_init(struct cm_trace_ring *ring, uint32_t capacity, uint32_t tid, const char *thread_name);
+void cm_trace_ring_free(struct cm_trace_ring *ring);
+
+static inline void cm_trace_ring_push(struct cm_trace_ring *ring, const char *name, char phase, uint64_t ts,
+				      int64_t arg)
+{
+	struct cm_trace_event *e = &ring->events[ring->n_pushed % ring->capacity];
+	e->name = name;
+	e->ts = ts;
+	e->arg = arg;
+	e->phase = phase;
+	ring->n_pushed++;
+}
+
+/*
+ * Writes the events remaining in the rings. The timestamps are written relative to `ts_origin`.
+ * An end event whose begin event was overwritten is not written.
+ * The rings must not be pushed while writing.
+ */
+bool cm_trace_write_json(FILE *fp, struct cm_trace_ring *const *rings, size_t n_rings, uint64_t ts_origin);
+
+#ifdef __cplusplus
+}
+#endif
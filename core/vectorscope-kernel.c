@@ -0,0 +1,29 @@
+#include "vectorscope-kernel.h"
+
+#define VS_SIZE VSS_KERNEL_SIZE
+
+void vss_kernel_rows(uint8_t *dbuf, const struct cm_surface_data *surface_data, uint32_t y0, uint32_t y1)
+{
+	const uint32_t width = cm_surface_uv_width(surface_data);
+	const uint32_t step = surface_data->uv_step;
+	const uint32_t uy0 = cm_surface_uv_row(surface_data, y0);
+	const uint32_t uy1 = cm_surface_uv_row(surface_data, y1);
+	const uint32_t w = 1u << (surface_data->uv_shift_x + surface_data->uv_shift_y);
+	for (uint32_t y = uy0; y < uy1; y++) {
+		const uint8_t *pu = surface_data->u_data + surface_data->uv_linesize * y;
+		const uint8_t *pv = surface_data->v_data + surface_data->uv_linesize * y;
+		for (uint32_t x = 0; x < width; x++, pu += step, pv += step) {
+			uint8_t *c = dbuf + (*pu + VS_SIZE * (255 - *pv));
+			const uint32_t n = *c + w;
+			*c = n < 255 ? (uint8_t)n : 255;
+		}
+	}
+}
+
+void vss_kernel_merge(uint8_t *dbuf, const uint8_t *partial)
+{
+	for (int i = 0; i < VS_SIZE * VS_SIZE; i++) {
+		uint32_t c = dbuf[i] + partial[i];
+		dbuf[i] = c < 255 ? (uint8_t)c : 255;
+	}
+}
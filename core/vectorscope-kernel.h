@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Vectorscope accumulation kernel.
+ * The output `dbuf` is 256 x 256 bytes; U goes to the right and V goes to the top.
+ * Each count saturates at 255.
+ * This file does not depend on libobs.
+ */
+
+#define VSS_KERNEL_SIZE 256
+
+/* Adds the U and V samples of the luma rows [y0, y1) into `dbuf`.
+ * A subsampled sample is counted as many times as the luma samples it covers. */
+void vss_kernel_rows(uint8_t *dbuf, const struct cm_surface_data *surface_data, uint32_t y0, uint32_t y1);
+
+/* Adds `partial` into `dbuf` with saturation.
+ * Saturating sum of the saturated partial counts is same as the saturated total count. */
+void vss_kernel_merge(uint8_t *dbuf, const uint8_t *partial);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+#include <stdbool.h>
+#include <string.h>
+#include "waveform-kernel.h"
+
+#define WV_SIZE WVS_KERNEL_SIZE
+#define TILE_COLUMNS 32 // columns accumulated at once; the tile fits in L1 cache
+
+static inline void inc_uint8(uint8_t *c)
+{
+	if (*c < 255)
+		++*c;
+}
+
+// Returns the first source column binned into the output column `o`.
+static inline uint32_t src_column(uint32_t o, uint32_t width, uint32_t out_width)
+{
+	return (uint32_t)(((uint64_t)o * width + out_width - 1) / out_width);
+}
+
+/*
+ * Accumulates output columns [o0, o1) into `tile` whose layout is level-major for each column,
+ * ie. `tile[(o - o0) * WV_SIZE * 4 + level * 4 + channel]`, so that all the counters of
+ * the columns stay in the cache while the source rows are scanned.
+ * Source columns are binned into `out_width` output columns.
+ */
+static inline void draw_tile_rgb(uint8_t *tile, uint32_t components, const struct cm_surface_data *surface_data,
+				 const uint32_t *xs, uint32_t n)
+{
+	const uint32_t height = surface_data->height;
+
+	const bool calc_b = (components & 0x01) ? true : false;
+	const bool calc_g = (components & 0x02) ? true : false;
+	const bool calc_r = (components & 0x04) ? true : false;
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *v = surface_data->rgb_data + surface_data->linesize * y + xs[0] * 4;
+		uint8_t *t = tile;
+		for (uint32_t i = 0; i < n; i++, t += WV_SIZE * 4) {
+			for (uint32_t x = xs[i]; x < xs[i + 1]; x++) {
+				const uint8_t b = *v++;
+				const uint8_t g = *v++;
+				const uint8_t r = *v++;
+				const uint8_t a = *v++;
+				if (!a)
+					continue;
+				if (calc_b)
+					inc_uint8(t + b * 4 + 0);
+				if (calc_g)
+					inc_uint8(t + g * 4 + 1);
+				if (calc_r)
+					inc_uint8(t + r * 4 + 2);
+			}
+		}
+	}
+}
+
+static inline void add_uint8(uint8_t *c, uint32_t w)
+{
+	const uint32_t n = *c + w;
+	*c = n < 255 ? (uint8_t)n : 255;
+}
+
+/*
+ * Same as above but from Y and UV planes; U, Y, and V go to the channel 0, 1, and 2, respectively.
+ * A subsampled chroma sample is counted as many times as the luma samples it covers.
+ */
+static inline void draw_tile_yuv(uint8_t *tile, uint32_t components, const struct cm_surface_data *surface_data,
+				 const uint32_t *xs, uint32_t n)
+{
+	const uint32_t height = surface_data->height;
+	const uint32_t uv_step = surface_data->uv_step;
+
+	const bool calc_u = (components & 0x10) ? true : false;
+	const bool calc_y = (components & 0x20) ? true : false;
+	const bool calc_v = (components & 0x40) ? true : false;
+
+	if (calc_y) {
+		for (uint32_t y = 0; y < height; y++) {
+			const uint8_t *p = surface_data->y_data + surface_data->y_linesize * y + xs[0];
+			uint8_t *t = tile;
+			for (uint32_t i = 0; i < n; i++, t += WV_SIZE * 4) {
+				for (uint32_t x = xs[i]; x < xs[i + 1]; x++)
+					inc_uint8(t + *p++ * 4 + 1);
+			}
+		}
+	}
+
+	if (!calc_u && !calc_v)
+		return;
+
+	const uint32_t sx = surface_data->uv_shift_x;
+	const uint32_t w = 1u << (sx + surface_data->uv_shift_y);
+	uint32_t uxs[TILE_COLUMNS + 1];
+	for (uint32_t i = 0; i <= n; i++)
+		uxs[i] = (xs[i] + (1u << sx) - 1) >> sx;
+
+	const uint32_t uv_height = cm_surface_uv_height(surface_data);
+	for (uint32_t y = 0; y < uv_height; y++) {
+		const uint32_t offset = surface_data->uv_linesize * y + uxs[0] * uv_step;
+		const uint8_t *pu = surface_data->u_data + offset;
+		const uint8_t *pv = surface_data->v_data + offset;
+		uint8_t *t = tile;
+		for (uint32_t i = 0; i < n; i++, t += WV_SIZE * 4) {
+			for (uint32_t x = uxs[i]; x < uxs[i + 1]; x++, pu += uv_step, pv += uv_step) {
+				if (calc_u)
+					add_uint8(t + *pu * 4 + 0, w);
+				if (calc_v)
+					add_uint8(t + *pv * 4 + 2, w);
+			}
+		}
+	}
+}
+
+static inline void draw_tile(uint8_t *tile, uint32_t components, const struct cm_surface_data *surface_data,
+			     uint32_t out_width, uint32_t o0, uint32_t o1)
+{
+	uint32_t xs[TILE_COLUMNS + 1];
+	for (uint32_t o = o0; o <= o1; o++)
+		xs[o - o0] = src_column(o, surface_data->width, out_width);
+
+	memset(tile, 0, (o1 - o0) * WV_SIZE * 4);
+
+	if (components & 0x07)
+		draw_tile_rgb(tile, components, surface_data, xs, o1 - o0);
+	else
+		draw_tile_yuv(tile, components, surface_data, xs, o1 - o0);
+}
+
+// Transposes the tile into the BGRX layout of the texture.
+static inline void transpose_tile(uint8_t *dbuf, const uint8_t *tile, uint32_t out_width, uint32_t o0, uint32_t o1)
+{
+	for (uint32_t level = 0; level < WV_SIZE; level++) {
+		uint32_t *d = (uint32_t *)(dbuf + (WV_SIZE - 1 - level) * out_width * 4) + o0;
+		const uint32_t *t = (const uint32_t *)tile + level;
+		for (uint32_t o = o0; o < o1; o++, t += WV_SIZE)
+			*d++ = *t;
+	}
+}
+
+void wvs_kernel_columns(uint8_t *dbuf, const struct cm_surface_data *surface_data, uint32_t components,
+			uint32_t out_width, uint32_t o0, uint32_t o1)
+{
+	uint32_t tile[TILE_COLUMNS * WV_SIZE];
+
+	for (uint32_t ot = o0; ot < o1; ot += TILE_COLUMNS) {
+		const uint32_t ot1 = ot + TILE_COLUMNS < o1 ? ot + TILE_COLUMNS : o1;
+		draw_tile((uint8_t *)tile, components, surface_data, out_width, ot, ot1);
+		transpose_tile(dbuf, (const uint8_t *)tile, out_width, ot, ot1);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "surface-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Waveform accumulation kernel.
+ * The output `dbuf` is BGRX of `out_width` x 256, the top row is the level 255.
+ * Source columns are binned into `out_width` columns. Each count saturates at 255.
+ * `components` has the same bits as the property of the waveform source;
+ * 0x04, 0x02, and 0x01 for R, G, and B from `rgb_data`, which go to the byte 2, 1, and 0, or
+ * 0x40, 0x20, and 0x10 for V, Y, and U from the planes, which go to the byte 2, 1, and 0.
+ * Pixels having zero alpha in `rgb_data` are skipped.
+ * Subsampled U and V are counted as many times as the luma samples each chroma sample covers.
+ * This file does not depend on libobs.
+ */
+
+#define WVS_KERNEL_SIZE 256
+
+// Overwrites the output columns [o0, o1) of `dbuf`.
+void wvs_kernel_columns(uint8_t *dbuf, const struct cm_surface_data *surface_data, uint32_t components,
+			uint32_t out_width, uint32_t o0, uint32_t o1);
+
+#ifdef __cplusplus
+}
+#endif
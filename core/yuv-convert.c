@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include "yuv-convert.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define YUV_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define YUV_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Coefficients are scaled by 2^14 and applied to 8-bit components.
+ * They are same as the conversion shaders in common.effect so that the result is
+ * same as the GPU path except for the rounding.
+ */
+#define SHIFT 14
+#define FIX(x) ((int)((x) * (1 << SHIFT) + ((x) >= 0 ? 0.5 : -0.5)))
+// Offset in the range of 8-bit components including 0.5 for rounding
+#define OFFSET(x) ((int32_t)(((x) * 255.0 + 0.5) * (1 << SHIFT) + 0.5))
+
+struct coefficients
+{
+	int16_t r, g, b;
+	int32_t offset;
+};
+
+// Y, U, V
+static const struct coefficients coef_601[3] = {
+	{FIX(+0.299000), FIX(+0.587000), FIX(+0.114000), OFFSET(0.0)},
+	{FIX(-0.147643), FIX(-0.289855), FIX(+0.437500), OFFSET(0.5 - 1.0 / 256.0)},
+	{FIX(+0.437500), FIX(-0.366351), FIX(-0.071147), OFFSET(0.5)},
+};
+
+static const struct coefficients coef_709[3] = {
+	{FIX(+0.212600), FIX(+0.715200), FIX(+0.072200), OFFSET(0.0)},
+	{FIX(-0.100643), FIX(-0.338571), FIX(+0.439216), OFFSET(0.5 - 1.0 / 256.0)},
+	{FIX(+0.439216), FIX(-0.398941), FIX(-0.040273), OFFSET(0.5)},
+};
+
+static inline uint8_t convert1(const struct coefficients *c, int r, int g, int b)
+{
+	int32_t x = c->r * r + c->g * g + c->b * b + c->offset;
+	if (x < 0)
+		return 0;
+	x >>= SHIFT;
+	return x > 255 ? 255 : (uint8_t)x;
+}
+
+static void convert_row_scalar(uint8_t *y_row, uint8_t *uv_row, const uint8_t *rgb_row, uint32_t x0, uint32_t width,
+			       const struct coefficients *c)
+{
+	for (uint32_t x = x0; x < width; x++) {
+		const uint8_t *p = rgb_row + x * 4;
+		if (y_row)
+			y_row[x] = convert1(c + 0, p[2], p[1], p[0]);
+		if (uv_row) {
+			uv_row[x * 2 + 0] = convert1(c + 1, p[2], p[1], p[0]);
+			uv_row[x * 2 + 1] = convert1(c + 2, p[2], p[1], p[0]);
+		}
+	}
+}
+
+void cm_rgb_to_yuv_scalar(uint8_t *y_data, uint32_t y_linesize, uint8_t *uv_data, uint32_t uv_linesize,
+			  const uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height, bool bt601)
+{
+	const struct coefficients *c = bt601 ? coef_601 : coef_709;
+
+	for (uint32_t y = 0; y < height; y++) {
+		convert_row_scalar(y_data ? y_data + y_linesize * y : NULL, uv_data ? uv_data + uv_linesize * y : NULL,
+				   rgb_data + linesize * y, 0, width, c);
+	}
+}
+
+#ifdef YUV_CONVERT_SSE2
+// Converts 4 pixels into 32-bit results.
+static inline __m128i convert4_sse2(__m128i px, __m128i coef, __m128i offset)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = _mm_unpacklo_epi8(px, zero); // B0 G0 R0 A0 B1 G1 R1 A1
+	const __m128i hi = _mm_unpackhi_epi8(px, zero); // B2 G2 R2 A2 B3 G3 R3 A3
+
+	// 32-bit lanes are (B * b + G * g, R * r + A * 0) for each pixel.
+	const __m128 m_lo = _mm_castsi128_ps(_mm_madd_epi16(lo, coef));
+	const __m128 m_hi = _mm_castsi128_ps(_mm_madd_epi16(hi, coef));
+	const __m128i bg = _mm_castps_si128(_mm_shuffle_ps(m_lo, m_hi, _MM_SHUFFLE(2, 0, 2, 0)));
+	const __m128i r = _mm_castps_si128(_mm_shuffle_ps(m_lo, m_hi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(bg, r), offset), SHIFT);
+}
+
+// Converts 16 pixels into 16 bytes.
+static inline __m128i convert16_sse2(const uint8_t *p, const struct coefficients *c)
+{
+	const __m128i coef = _mm_setr_epi16(c->b, c->g, c->r, 0, c->b, c->g, c->r, 0);
+	const __m128i offset = _mm_set1_epi32(c->offset);
+
+	__m128i x0 = convert4_sse2(_mm_loadu_si128((const __m128i *)p + 0), coef, offset);
+	__m128i x1 = convert4_sse2(_mm_loadu_si128((const __m128i *)p + 1), coef, offset);
+	__m128i x2 = convert4_sse2(_mm_loadu_si128((const __m128i *)p + 2), coef, offset);
+	__m128i x3 = convert4_sse2(_mm_loadu_si128((const __m128i *)p + 3), coef, offset);
+
+	// Saturation of the packing clamps the result into [0, 255].
+	return _mm_packus_epi16(_mm_packs_epi32(x0, x1), _mm_packs_epi32(x2, x3));
+}
+
+static void convert_row_sse2(uint8_t *y_row, uint8_t *uv_row, const uint8_t *rgb_row, uint32_t width,
+			     const struct coefficients *c)
+{
+	uint32_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const uint8_t *p = rgb_row + x * 4;
+		if (y_row)
+			_mm_storeu_si128((__m128i *)(y_row + x), convert16_sse2(p, c + 0));
+		if (uv_row) {
+			const __m128i u = convert16_sse2(p, c + 1);
+			const __m128i v = convert16_sse2(p, c + 2);
+			_mm_storeu_si128((__m128i *)(uv_row + x * 2), _mm_unpacklo_epi8(u, v));
+			_mm_storeu_si128((__m128i *)(uv_row + x * 2 + 16), _mm_unpackhi_epi8(u, v));
+		}
+	}
+	convert_row_scalar(y_row, uv_row, rgb_row, x, width, c);
+}
+#endif // YUV_CONVERT_SSE2
+
+#ifdef YUV_CONVERT_NEON
+static inline int32x4_t convert4_neon(int16x4_t r, int16x4_t g, int16x4_t b, const struct coefficients *c)
+{
+	int32x4_t x = vdupq_n_s32(c->offset);
+	x = vmlal_n_s16(x, r, c->r);
+	x = vmlal_n_s16(x, g, c->g);
+	x = vmlal_n_s16(x, b, c->b);
+	return vshrq_n_s32(x, SHIFT);
+}
+
+// Converts 8 pixels into 8 bytes.
+static inline uint8x8_t convert8_neon(uint8x8x4_t px, const struct coefficients *c)
+{
+	const int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(px.val[0]));
+	const int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(px.val[1]));
+	const int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(px.val[2]));
+	const int32x4_t lo = convert4_neon(vget_low_s16(r), vget_low_s16(g), vget_low_s16(b), c);
+	const int32x4_t hi = convert4_neon(vget_high_s16(r), vget_high_s16(g), vget_high_s16(b), c);
+	return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+static void convert_row_neon(uint8_t *y_row, uint8_t *uv_row, const uint8_t *rgb_row, uint32_t width,
+			     const struct coefficients *c)
+{
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8) {
+		const uint8x8x4_t px = vld4_u8(rgb_row + x * 4);
+		if (y_row)
+			vst1_u8(y_row + x, convert8_neon(px, c + 0));
+		if (uv_row) {
+			uint8x8x2_t uv;
+			uv.val[0] = convert8_neon(px, c + 1);
+			uv.val[1] = convert8_neon(px, c + 2);
+			vst2_u8(uv_row + x * 2, uv);
+		}
+	}
+	convert_row_scalar(y_row, uv_row, rgb_row, x, width, c);
+}
+#endif // YUV_CONVERT_NEON
+
+void cm_rgb_to_yuv(uint8_t *y_data, uint32_t y_linesize, uint8_t *uv_data, uint32_t uv_linesize,
+		   const uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height, bool bt601)
+{
+#if defined(YUV_CONVERT_SSE2) || defined(YUV_CONVERT_NEON)
+	const struct coefficients *c = bt601 ? coef_601 : coef_709;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *y_row = y_data ? y_data + y_linesize * y : NULL;
+		uint8_t *uv_row = uv_data ? uv_data + uv_linesize * y : NULL;
+		const uint8_t *rgb_row = rgb_data + linesize * y;
+#ifdef YUV_CONVERT_SSE2
+		convert_row_sse2(y_row, uv_row, rgb_row, width, c);
+#else
+		convert_row_neon(y_row, uv_row, rgb_row, width, c);
+#endif
+	}
+#else
+	cm_rgb_to_yuv_scalar(y_data, y_linesize, uv_data, uv_linesize, rgb_data, linesize, width, height, bt601);
+#endif
+}
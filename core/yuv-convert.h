@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RGB to YUV conversion on the CPU with fixed-point arithmetic.
+ * The input is BGRA. The output is a Y plane and an interleaved UV plane (U0 V0 U1 V1 ...),
+ * which is the same layout as the packed planes read back from the GPU.
+ * Either `y_data` or `uv_data` can be NULL to skip the plane.
+ * `bt601` selects BT.601 coefficients, otherwise BT.709. The alpha channel is ignored.
+ * This file does not depend on libobs.
+ */
+
+typedef void (*cm_rgb_to_yuv_func_t)(uint8_t *y_data, uint32_t y_linesize, uint8_t *uv_data, uint32_t uv_linesize,
+				     const uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height,
+				     bool bt601);
+
+// Reference implementation
+void cm_rgb_to_yuv_scalar(uint8_t *y_data, uint32_t y_linesize, uint8_t *uv_data, uint32_t uv_linesize,
+			  const uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height, bool bt601);
+
+// Vectorized implementation if available for the architecture, otherwise same as the reference.
+void cm_rgb_to_yuv(uint8_t *y_data, uint32_t y_linesize, uint8_t *uv_data, uint32_t uv_linesize,
+		   const uint8_t *rgb_data, uint32_t linesize, uint32_t width, uint32_t height, bool bt601);
+
+#ifdef __cplusplus
+}
+#endif
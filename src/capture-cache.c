@@ -0,0 +1,138 @@
+#include <obs-module.h>
+#include <util/darray.h>
+#include "plugin-macros.generated.h"
+#include "common.h"
+#include "frame-replay.h"
+#include "capture-cache.h"
+
+#define CM_CAPTURE_FLAGS (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_YUV)
+
+static pthread_mutex_t captures_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct cm_capture *) captures;
+
+static void capture_surface_cb(void *data, struct cm_surface_data *surface_data);
+
+bool cm_capture_shareable(const struct cm_source *src)
+{
+	if (src->bypass || !src->callback)
+		return false;
+	if (src->scale_mode != CM_SCALE_MANUAL)
+		return false;
+	if (src->flags & (CM_FLAG_RAW_TEXTURE | CM_FLAG_ROI | CM_FLAG_SHARED))
+		return false;
+	return !!(src->flags & CM_CAPTURE_FLAGS);
+}
+
+bool cm_capture_match(const struct cm_capture *cap, const struct cm_source *src)
+{
+	const struct cm_source *cm = &cap->cm;
+
+	if (!src->target_name || strcmp(cm->target_name, src->target_name) != 0)
+		return false;
+	if (cm->target_scale != src->target_scale)
+		return false;
+	if (cm->colorspace != src->colorspace)
+		return false;
+	if (cm->analysis_rate != src->analysis_rate)
+		return false;
+	if (cm->chroma_subsampling != src->chroma_subsampling)
+		return false;
+	if (cm->n_bands != src->n_bands)
+		return false;
+	if ((cm->flags & CM_CAPTURE_FLAGS) != (src->flags & CM_CAPTURE_FLAGS))
+		return false;
+	return true;
+}
+
+static struct cm_capture *capture_create(const struct cm_source *src)
+{
+	struct cm_capture *cap = bzalloc(sizeof(struct cm_capture));
+
+	cap->cm.flags = CM_FLAG_SHARED | (src->flags & CM_CAPTURE_FLAGS);
+	cm_create(&cap->cm, NULL, NULL);
+	cm_request(&cap->cm, capture_surface_cb, cap);
+
+	cap->cm.target_name = bstrdup(src->target_name);
+	cap->cm.target_scale = src->target_scale;
+	cap->cm.colorspace = src->colorspace;
+	cap->cm.analysis_rate = src->analysis_rate;
+	cap->cm.chroma_subsampling = src->chroma_subsampling;
+	cap->cm.n_bands = src->n_bands;
+
+	pthread_mutex_init(&cap->consumers_mutex, NULL);
+
+	blog(LOG_DEBUG, "created capture %p scale=%d colorspace=%d flags=0x%x", cap, cap->cm.target_scale,
+	     cap->cm.colorspace, cap->cm.flags);
+
+	return cap;
+}
+
+static void capture_destroy(struct cm_capture *cap)
+{
+	blog(LOG_DEBUG, "destroying capture %p", cap);
+
+	cm_destroy(&cap->cm);
+	da_free(cap->consumers);
+	pthread_mutex_destroy(&cap->consumers_mutex);
+
+	bfree(cap);
+}
+
+struct cm_capture *cm_capture_get(struct cm_source *src)
+{
+	struct cm_capture *cap = NULL;
+
+	pthread_mutex_lock(&captures_mutex);
+	for (size_t i = 0; i < captures.num; i++) {
+		if (cm_capture_match(captures.array[i], src)) {
+			cap = captures.array[i];
+			break;
+		}
+	}
+	if (!cap) {
+		cap = capture_create(src);
+		da_push_back(captures, &cap);
+	}
+	cap->refs++;
+	pthread_mutex_unlock(&captures_mutex);
+
+	pthread_mutex_lock(&cap->consumers_mutex);
+	da_push_back(cap->consumers, &src);
+	pthread_mutex_unlock(&cap->consumers_mutex);
+
+	// The new consumer has to be given a frame even if the frame is static.
+	os_atomic_set_bool(&cap->cm.refresh_requested, true);
+
+	return cap;
+}
+
+void cm_capture_release(struct cm_capture *cap, struct cm_source *src)
+{
+	pthread_mutex_lock(&cap->consumers_mutex);
+	da_erase_item(cap->consumers, &src);
+	pthread_mutex_unlock(&cap->consumers_mutex);
+
+	pthread_mutex_lock(&captures_mutex);
+	bool last = --cap->refs == 0;
+	if (last) {
+		da_erase_item(captures, &cap);
+		if (!captures.num)
+			da_free(captures);
+	}
+	pthread_mutex_unlock(&captures_mutex);
+
+	if (last)
+		capture_destroy(cap);
+}
+
+static void capture_surface_cb(void *data, struct cm_surface_data *surface_data)
+{
+	struct cm_capture *cap = data;
+
+	pthread_mutex_lock(&cap->consumers_mutex);
+	for (size_t i = 0; i < cap->consumers.num; i++) {
+		struct cm_source *cm = cap->consumers.array[i];
+		cm_deliver_surface(cm, surface_data);
+	}
+	pthread_mutex_unlock(&cap->consumers_mutex);
+}
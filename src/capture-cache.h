@@ -0,0 +1,31 @@
+#pragma once
+
+#include <util/darray.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process-wide cache of captures.
+ * Sources having the same target, scale, color space, analysis rate, chroma subsampling, and flags share one
+ * capture so that the target is rendered and read back only once per frame.
+ */
+struct cm_capture
+{
+	struct cm_source cm;
+	long refs; // protected by the global mutex
+
+	pthread_mutex_t consumers_mutex;
+	DARRAY(struct cm_source *) consumers;
+};
+
+bool cm_capture_shareable(const struct cm_source *src);
+bool cm_capture_match(const struct cm_capture *cap, const struct cm_source *src);
+struct cm_capture *cm_capture_get(struct cm_source *src);
+void cm_capture_release(struct cm_capture *cap, struct cm_source *src);
+
+#ifdef __cplusplus
+}
+#endif
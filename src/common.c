@@ -1,24 +1,62 @@
 #include <obs-module.h>
+#include <math.h>
 #include <util/platform.h>
+#include <util/dstr.h>
 #include <obs-frontend-api.h>
 #include "plugin-macros.generated.h"
 #include "obs-convenience.h"
 #include "common.h"
 #include "util.h"
 #include "roi.h"
+#include "capture-cache.h"
+#include "raw-video.h"
+#include "render-pyramid.h"
+#include "scope-tap.h"
+#include "yuv-convert.h"
+#include "worker-pool.h"
+#include "frame-replay.h"
+#include "source-stats.h"
+#include "trace.h"
+#include "fingerprint.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_pipeline_thread = "cm_pipeline_thread_loop";
 static const char *prof_render_target_name = "render_target";
 static const char *prof_convert_yuv_name = "convert_yuv";
 static const char *prof_stage_surface_name = "stage_surface";
 static const char *prof_stagesurface_map_name = "stage_surface_map";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
+static const char *prof_convert_yuv_cpu_name = "convert_yuv_cpu";
+
+#define CM_SURFACE_MAX_WIDTH 16384
+#define CONVERT_BAND_MIN_PIXELS 65536
+
+#define FINGERPRINT_ROW_STEP 8
+#define STATIC_REFRESH_NS 1000000000ULL // a static frame is analyzed at least at this interval
+
+#define VISIBLE_TIMEOUT_NS 500000000ULL // a scope not rendered within this time is regarded as hidden
+
+#define SCALE_MAX 128
+#define SCALE_HYSTERESIS 0.15 // the automatic scale does not change while the error is within this ratio
+#define ANALYSIS_TIME_SMOOTHING 0.2
+
+static bool cpu_yuv_conversion = false;
+static bool skip_static_frames = true;
+static uint64_t hidden_render_interval_ns = 0; // 0 to pause the hidden scopes
+static volatile long n_analysis_phases = 0;
+
+void cm_set_cpu_yuv_conversion(bool enable)
+{
+	cpu_yuv_conversion = enable;
+}
+
+void cm_set_skip_static_frames(bool enable)
+{
+	skip_static_frames = enable;
+}
+
+void cm_set_hidden_scope_rate(int rate)
+{
+	hidden_render_interval_ns = rate > 0 ? 1000000000ULL / rate : 0;
+}
 
 void cm_create(struct cm_source *src, obs_data_t *settings, obs_source_t *source)
 {
@@ -31,16 +69,21 @@ void cm_create(struct cm_source *src, obs_data_t *settings, obs_source_t *source
 	obs_leave_graphics();
 
 	src->i_write_queue = 0;
-	src->i_staging_queue = 0;
-	src->i_read_queue = CM_SURFACE_QUEUE_SIZE - 1;
+	src->ready = 1;
+	src->i_read_queue = 2;
+	src->refresh_requested = true;
 
 	pthread_mutex_init(&src->target_update_mutex, NULL);
-	pthread_mutex_init(&src->pipeline_mutex, NULL);
-	pthread_cond_init(&src->pipeline_cond, NULL);
+	os_event_init(&src->pipeline_event, OS_EVENT_TYPE_AUTO);
+
+	cm_frame_replay_init(src);
+	cm_stats_init(src);
 }
 
 static void release_roi_src(struct cm_source *src);
-static void stop_pipeline_thread(struct cm_source *src);
+static void release_scope_tap(struct cm_source *src);
+static void release_capture(struct cm_source *src);
+static void release_pyramid(struct cm_source *src);
 
 void cm_destroy(struct cm_source *src)
 {
@@ -48,24 +91,45 @@ void cm_destroy(struct cm_source *src)
 		release_roi_src(src);
 	}
 
-	stop_pipeline_thread(src);
+	release_scope_tap(src);
+
+	release_capture(src);
+
+	cm_raw_video_release(src);
+
+	release_pyramid(src);
+
+	cm_stop_pipeline_thread(src);
+
+	cm_frame_replay_free(src);
 
 	obs_enter_graphics();
 	for (int i = 0; i < CM_SURFACE_QUEUE_SIZE; i++) {
+		if (src->queue[i].video_data)
+			gs_stagesurface_unmap(src->queue[i].stagesurface);
 		gs_stagesurface_destroy(src->queue[i].stagesurface);
 		gs_texrender_destroy(src->queue[i].texrender);
+		bfree(src->queue[i].raw_data);
 	}
 	if (src->texrender)
 		gs_texrender_destroy(src->texrender);
 	obs_leave_graphics();
 
-	pthread_mutex_destroy(&src->pipeline_mutex);
-	pthread_cond_destroy(&src->pipeline_cond);
+	os_event_destroy(src->pipeline_event);
+
+	long dropped_frames = os_atomic_load_long(&src->dropped_frames);
+	if (dropped_frames)
+		blog(LOG_INFO, "'%s': %ld frames were dropped before analyzed",
+		     src->self ? obs_source_get_name(src->self) : "(shared)", dropped_frames);
+
+	cm_stats_free(src);
 
 	pthread_mutex_destroy(&src->target_update_mutex);
 	obs_weak_source_release(src->weak_target);
 
 	bfree(src->target_name);
+	bfree(src->cpu_yuv_buf);
+	cm_band_assembly_free(&src->bands);
 }
 
 void cm_update(struct cm_source *src, obs_data_t *settings)
@@ -89,12 +153,42 @@ void cm_update(struct cm_source *src, obs_data_t *settings)
 	if (src->target_scale < 1)
 		src->target_scale = 1;
 
+	int scale_mode = (int)obs_data_get_int(settings, "scale_mode");
+	if (scale_mode != src->scale_mode || scale_mode == CM_SCALE_MANUAL) {
+		// Start from the manual scale, which is also the scale when the budget cannot be measured.
+		os_atomic_set_long(&src->auto_scale, src->target_scale * CM_SCALE_ONE);
+		src->scale_mode = scale_mode;
+	}
+	src->scale_budget_ns = (uint64_t)(obs_data_get_double(settings, "scale_budget_ms") * 1e6);
+	src->scale_budget_pixels = (uint64_t)(obs_data_get_double(settings, "scale_budget_mpx") * 1e6);
+
+	const double analysis_rate = obs_data_get_double(settings, "analysis_rate");
+	if (analysis_rate != src->analysis_rate) {
+		src->analysis_rate = analysis_rate;
+		os_atomic_set_long(&src->analysis_phase, 0);
+	}
+
+	src->chroma_subsampling = (int)obs_data_get_int(settings, "chroma_subsampling");
+
+	src->n_bands = (int)obs_data_get_int(settings, "readback_bands");
+	if (src->n_bands < 1)
+		src->n_bands = 1;
+	if (src->n_bands > CM_READBACK_MAX_BANDS)
+		src->n_bands = CM_READBACK_MAX_BANDS;
+
 	src->bypass = obs_data_get_bool(settings, "bypass");
 
 	int colorspace = (int)obs_data_get_int(settings, "colorspace");
 	src->colorspace = calc_colorspace(colorspace);
 }
 
+void cm_get_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_double(settings, "scale_budget_ms", 2.0);
+	obs_data_set_default_double(settings, "scale_budget_mpx", 0.5);
+	obs_data_set_default_int(settings, "readback_bands", 1);
+}
+
 void cm_enum_sources(void *data, obs_source_enum_proc_t enum_callback, void *param)
 {
 	struct cm_source *src = data;
@@ -111,6 +205,15 @@ void cm_enum_sources(void *data, obs_source_enum_proc_t enum_callback, void *par
 	src->enumerating = 0;
 }
 
+static bool scale_mode_modified(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(property);
+	const int scale_mode = (int)obs_data_get_int(settings, "scale_mode");
+	obs_property_set_visible(obs_properties_get(props, "scale_budget_ms"), scale_mode == CM_SCALE_TIME);
+	obs_property_set_visible(obs_properties_get(props, "scale_budget_mpx"), scale_mode == CM_SCALE_PIXELS);
+	return true;
+}
+
 void cm_get_properties(struct cm_source *src, obs_properties_t *props)
 {
 	if (!src)
@@ -121,26 +224,141 @@ void cm_get_properties(struct cm_source *src, obs_properties_t *props)
 	prop = obs_properties_add_list(props, "target_name", obs_module_text("Source"), OBS_COMBO_TYPE_LIST,
 				       OBS_COMBO_FORMAT_STRING);
 	property_list_add_sources(prop, src ? src->self : NULL);
-	obs_properties_add_int(props, "target_scale", obs_module_text("Scale"), 1, 128, 1);
+	obs_properties_add_int(props, "target_scale", obs_module_text("Scale"), 1, SCALE_MAX, 1);
+
+	prop = obs_properties_add_list(props, "scale_mode", obs_module_text("Scale.Mode"), OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("Scale.Mode.Manual"), CM_SCALE_MANUAL);
+	obs_property_list_add_int(prop, obs_module_text("Scale.Mode.Time"), CM_SCALE_TIME);
+	obs_property_list_add_int(prop, obs_module_text("Scale.Mode.Pixels"), CM_SCALE_PIXELS);
+	obs_property_set_modified_callback(prop, scale_mode_modified);
+
+	prop = obs_properties_add_float(props, "scale_budget_ms", obs_module_text("Scale.Budget.Time"), 0.1, 100.0,
+					0.1);
+	obs_property_float_set_suffix(prop, " ms");
+	prop = obs_properties_add_float(props, "scale_budget_mpx", obs_module_text("Scale.Budget.Pixels"), 0.01,
+					100.0, 0.01);
+	obs_property_float_set_suffix(prop, " Mpx");
+
+	if (!(src->flags & (CM_FLAG_ROI | CM_FLAG_RAW_TEXTURE))) {
+		prop = obs_properties_add_float(props, "analysis_rate", obs_module_text("AnalysisRate"), 0.0, 240.0,
+						1.0);
+		obs_property_float_set_suffix(prop, " Hz");
+
+		prop = obs_properties_add_list(props, "chroma_subsampling", obs_module_text("ChromaSubsampling"),
+					       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+		obs_property_list_add_int(prop, obs_module_text("Auto"), CM_CHROMA_AUTO);
+		obs_property_list_add_int(prop, obs_module_text("ChromaSubsampling.444"), CM_CHROMA_444);
+		obs_property_list_add_int(prop, obs_module_text("ChromaSubsampling.422"), CM_CHROMA_422);
+		obs_property_list_add_int(prop, obs_module_text("ChromaSubsampling.420"), CM_CHROMA_420);
+
+		obs_properties_add_int_slider(props, "readback_bands", obs_module_text("ReadbackBands"), 1,
+					      CM_READBACK_MAX_BANDS, 1);
+	}
 
 	if (!(src->flags & CM_FLAG_ROI))
 		obs_properties_add_bool(props, "bypass", obs_module_text("Bypass"));
 }
 
-static void prepare_stagesurface(struct cm_surface_queue_item *item, uint32_t width, uint32_t height, uint32_t sheight)
+static void unmap_stagesurface(struct cm_surface_queue_item *item)
+{
+	if (!item->video_data)
+		return;
+
+	gs_stagesurface_unmap(item->stagesurface);
+	item->video_data = NULL;
+}
+
+static void map_stagesurface(struct cm_source *src, struct cm_surface_queue_item *item)
+{
+	PROFILE_START(prof_stagesurface_map_name);
+	const uint64_t t = os_gettime_ns();
+	if (!gs_stagesurface_map(item->stagesurface, &item->video_data, &item->video_linesize))
+		item->video_data = NULL;
+	cm_stats_add(src, CM_STAT_MAP, os_gettime_ns() - t);
+	PROFILE_END(prof_stagesurface_map_name);
+}
+
+static void prepare_stagesurface(struct cm_surface_queue_item *item, uint32_t swidth, uint32_t sheight)
 {
-	if (width != item->width || sheight != item->sheight || !item->stagesurface) {
+	if (swidth != item->swidth || sheight != item->sheight || !item->stagesurface) {
 		gs_stagesurface_destroy(item->stagesurface);
-		item->stagesurface = gs_stagesurface_create(width, sheight, GS_BGRA);
-		item->width = width;
+		item->stagesurface = gs_stagesurface_create(swidth, sheight, GS_BGRA);
+		item->swidth = swidth;
 		item->sheight = sheight;
 	}
+}
+
+/*
+ * The subsampling of the chroma made by the GPU.
+ * The automatic mode subsamples only for the scopes analyzing U and V alone, such as the vectorscope.
+ */
+static void get_uv_shift(const struct cm_source *src, uint32_t flags, uint32_t *shift_x, uint32_t *shift_y)
+{
+	int mode = src->chroma_subsampling;
+	if (mode == CM_CHROMA_AUTO)
+		mode = (flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_Y)) ? CM_CHROMA_444 : CM_CHROMA_420;
+
+	*shift_x = mode == CM_CHROMA_422 || mode == CM_CHROMA_420 ? 1 : 0;
+	*shift_y = mode == CM_CHROMA_420 ? 1 : 0;
+}
+
+/*
+ * Places the planes on the surface side by side; RGB at the left, then packed Y and packed UV.
+ * If the surface would be too wide, the packed planes are placed below RGB.
+ * The subsampled UV plane is narrower and, for 4:2:0, shorter than the other planes.
+ * The surface is laid out for `surface_height` rows, which is larger than `height` for the last band of the
+ * progressive readback; the planes stay at the same places so that the surface is not recreated.
+ */
+static void layout_surface(struct cm_surface_queue_item *item, uint32_t width, uint32_t height,
+			   uint32_t surface_height)
+{
+	const uint32_t uv_width = (width + (1u << item->uv_shift_x) - 1) >> item->uv_shift_x;
+	const uint32_t uv_height = (surface_height + (1u << item->uv_shift_y) - 1) >> item->uv_shift_y;
+	const uint32_t rgb_w = item->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_RAW_TEXTURE) ? width : 0;
+	const uint32_t y_w = item->flags & CM_FLAG_CONVERT_Y ? (width + 3) / 4 : 0;
+	const uint32_t uv_w = item->flags & CM_FLAG_CONVERT_UV ? (uv_width + 1) / 2 : 0;
+	const uint32_t rgb_h = rgb_w ? surface_height : 0;
+	const uint32_t yuv_h = y_w ? surface_height : uv_w ? uv_height : 0;
+
+	uint32_t swidth, sheight;
+	if (rgb_w + y_w + uv_w <= CM_SURFACE_MAX_WIDTH) {
+		item->y_x = rgb_w;
+		item->yuv_y = 0;
+		swidth = rgb_w + y_w + uv_w;
+		sheight = rgb_h > yuv_h ? rgb_h : yuv_h;
+	} else {
+		item->y_x = 0;
+		item->yuv_y = surface_height;
+		swidth = rgb_w > y_w + uv_w ? rgb_w : y_w + uv_w;
+		sheight = surface_height + yuv_h;
+	}
+	item->uv_x = item->y_x + y_w;
+
+	item->width = width;
 	item->height = height;
+	prepare_stagesurface(item, swidth, sheight);
 }
 
-static bool render_target_to_texrender(obs_source_t *target, uint32_t target_width, uint32_t target_height,
-				       gs_texrender_t *texrender, uint32_t width, uint32_t height)
+/*
+ * Draws the target scaled down to `width` x `height` into `texrender`.
+ * The level of the shared pyramid is at most twice as large as the output so that the bilinear sampling
+ * covers all its texels, ie. the result is a box filter of the target.
+ */
+static bool render_scaled_target(struct cm_source *src, obs_source_t *target, double scale, gs_texrender_t *texrender,
+				 uint32_t width, uint32_t height)
 {
+	if (!src->pyramid || !cm_pyramid_match(src->pyramid, target)) {
+		cm_pyramid_release(src->pyramid);
+		src->pyramid = cm_pyramid_get(target);
+	}
+
+	uint32_t level_width, level_height;
+	gs_texture_t *tex = cm_pyramid_get_level(src->pyramid, cm_pyramid_level_for_scale(scale), &level_width,
+						 &level_height);
+	if (!tex)
+		return false;
+
 	gs_texrender_reset(texrender);
 	if (!gs_texrender_begin(texrender, width, height))
 		return false;
@@ -151,14 +369,14 @@ static bool render_target_to_texrender(obs_source_t *target, uint32_t target_wid
 	gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
 
 	gs_projection_push();
-	gs_ortho(0.0f, (float)target_width, 0.0f, (float)target_height, -100.0f, 100.0f);
+	gs_ortho(0.0f, (float)level_width, 0.0f, (float)level_height, -100.0f, 100.0f);
 
 	gs_blend_state_push();
-	if (target) {
-		gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
-		obs_source_video_render(target);
-	} else {
-		obs_render_main_texture();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), tex);
+	while (gs_effect_loop(effect, "Draw")) {
+		gs_draw_sprite(tex, 0, level_width, level_height);
 	}
 	gs_blend_state_pop();
 	gs_projection_pop();
@@ -167,13 +385,43 @@ static bool render_target_to_texrender(obs_source_t *target, uint32_t target_wid
 	return true;
 }
 
+static void release_pyramid(struct cm_source *src)
+{
+	cm_pyramid_release(src->pyramid);
+	src->pyramid = NULL;
+}
+
+/*
+ * Draws `n_pack` x `n_pack_y` source pixels into one texel.
+ * The vertical step is given to the shader only if the rows are packed.
+ */
+static void render_packed(gs_effect_t *effect, const char *technique, gs_texture_t *tex, uint32_t x, uint32_t y,
+			  uint32_t out_x, uint32_t out_y, uint32_t out_width, uint32_t out_height, uint32_t n_pack,
+			  uint32_t n_pack_y)
+{
+	struct vec2 packed_step = {
+		.x = 1.0f / gs_texture_get_width(tex),
+		.y = n_pack_y > 1 ? 1.0f / gs_texture_get_height(tex) : 0.0f,
+	};
+	gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "packed_step"), &packed_step);
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), tex);
+
+	gs_matrix_push();
+	gs_matrix_translate3f((float)out_x, (float)out_y, 0.0f);
+	gs_matrix_scale3f(1.0f / n_pack, 1.0f / n_pack_y, 1.0f);
+	while (gs_effect_loop(effect, technique)) {
+		gs_draw_sprite_subregion(tex, 0, x, y, out_width * n_pack, out_height * n_pack_y);
+	}
+	gs_matrix_pop();
+}
+
 static bool render_rgb_yuv(struct cm_source *src, struct cm_surface_queue_item *item, uint32_t x, uint32_t y)
 {
 	if (!item->texrender)
 		item->texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
 
 	gs_texrender_reset(item->texrender);
-	if (src->effect && gs_texrender_begin(item->texrender, item->width, item->sheight)) {
+	if (src->effect && gs_texrender_begin(item->texrender, item->swidth, item->sheight)) {
 		PROFILE_START(prof_convert_yuv_name);
 
 		struct vec4 background;
@@ -181,13 +429,10 @@ static bool render_rgb_yuv(struct cm_source *src, struct cm_surface_queue_item *
 		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
 
 		gs_projection_push();
-		gs_ortho(0.0f, (float)item->width, 0.0f, (float)item->sheight, -100.0f, 100.0f);
+		gs_ortho(0.0f, (float)item->swidth, 0.0f, (float)item->sheight, -100.0f, 100.0f);
 
 		gs_texture_t *tex = gs_texrender_get_texture(src->texrender);
 		if (tex) {
-
-			uint32_t offset = 0;
-
 			if (item->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_RAW_TEXTURE)) {
 				gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
 
@@ -195,22 +440,31 @@ static bool render_rgb_yuv(struct cm_source *src, struct cm_surface_queue_item *
 				while (gs_effect_loop(effect, "Draw")) {
 					gs_draw_sprite_subregion(tex, 0, x, y, item->width, item->height);
 				}
-
-				offset += item->height;
 			}
 
-			if (item->flags & CM_FLAG_CONVERT_YUV) {
-				if (offset) {
-					gs_matrix_translate3f(0.0f, (float)offset, 0.0f);
-				}
+			// The alpha channel of the packed planes holds a sample.
+			gs_blend_state_push();
+			gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
 
-				const char *conversion = src->colorspace == 1 ? "ConvertRGB_YUV601"
-									      : "ConvertRGB_YUV709";
-				gs_effect_set_texture(gs_effect_get_param_by_name(src->effect, "image"), tex);
-				while (gs_effect_loop(src->effect, conversion)) {
-					gs_draw_sprite_subregion(tex, 0, x, y, item->width, item->height);
-				}
+			const bool bt601 = src->colorspace == 1;
+			if (item->flags & CM_FLAG_CONVERT_Y) {
+				render_packed(src->effect, bt601 ? "ConvertRGB_Y601" : "ConvertRGB_Y709", tex, x, y,
+					      item->y_x, item->yuv_y, item->uv_x - item->y_x, item->height, 4, 1);
 			}
+
+			if (item->flags & CM_FLAG_CONVERT_UV && (item->uv_shift_x || item->uv_shift_y)) {
+				const uint32_t sx = item->uv_shift_x, sy = item->uv_shift_y;
+				const uint32_t uv_width = (item->width + (1u << sx) - 1) >> sx;
+				const uint32_t uv_height = (item->height + (1u << sy) - 1) >> sy;
+				const char *technique = bt601 ? "ConvertRGB_UV601_Sub" : "ConvertRGB_UV709_Sub";
+				render_packed(src->effect, technique, tex, x, y, item->uv_x, item->yuv_y,
+					      (uv_width + 1) / 2, uv_height, 4, 1u << sy);
+			} else if (item->flags & CM_FLAG_CONVERT_UV) {
+				render_packed(src->effect, bt601 ? "ConvertRGB_UV601" : "ConvertRGB_UV709", tex, x, y,
+					      item->uv_x, item->yuv_y, (item->width + 1) / 2, item->height, 2, 1);
+			}
+
+			gs_blend_state_pop();
 		}
 		gs_texrender_end(item->texrender);
 		gs_projection_pop();
@@ -220,21 +474,178 @@ static bool render_rgb_yuv(struct cm_source *src, struct cm_surface_queue_item *
 	return true;
 }
 
-void cm_render_target(struct cm_source *src)
+/*
+ * Returns `current` unless `desired` is off by more than SCALE_HYSTERESIS so that the scale does not
+ * oscillate between two values. The result is rounded to 1/CM_SCALE_ONE and clamped to [1, SCALE_MAX].
+ */
+static long scale_with_hysteresis(long current, double desired)
 {
-	if (src->rendered)
+	const double cur = (double)current / CM_SCALE_ONE;
+	if (current && desired > cur * (1.0 - SCALE_HYSTERESIS) && desired < cur * (1.0 + SCALE_HYSTERESIS))
+		return current;
+
+	if (desired < 1.0)
+		desired = 1.0;
+	if (desired > SCALE_MAX)
+		desired = SCALE_MAX;
+	return (long)(desired * CM_SCALE_ONE + 0.5);
+}
+
+static void set_auto_scale(struct cm_source *src, double desired)
+{
+	const long current = os_atomic_load_long(&src->auto_scale);
+	const long scale = scale_with_hysteresis(current, desired);
+	if (scale == current)
 		return;
-	src->rendered = 1;
+
+	os_atomic_set_long(&src->auto_scale, scale);
+	blog(LOG_DEBUG, "'%s': scale %.3f -> %.3f", src->self ? obs_source_get_name(src->self) : "(shared)",
+	     (double)current / CM_SCALE_ONE, (double)scale / CM_SCALE_ONE);
+}
+
+static double get_scale(struct cm_source *src, uint32_t target_width, uint32_t target_height)
+{
+	switch (src->scale_mode) {
+	case CM_SCALE_PIXELS:
+		if (src->scale_budget_pixels)
+			set_auto_scale(src, sqrt((double)target_width * target_height / src->scale_budget_pixels));
+		return (double)os_atomic_load_long(&src->auto_scale) / CM_SCALE_ONE;
+	case CM_SCALE_TIME:
+		return (double)os_atomic_load_long(&src->auto_scale) / CM_SCALE_ONE;
+	default:
+		return src->target_scale;
+	}
+}
+
+/*
+ * Called by the pipeline thread after a frame of `n_pixels` was analyzed in `ns`.
+ * The time is assumed to be proportional to the number of pixels, which is proportional to the
+ * inverse square of the scale.
+ */
+static void update_time_budget_scale(struct cm_source *src, uint64_t ns, uint64_t n_pixels)
+{
+	if (src->scale_mode != CM_SCALE_TIME || !src->scale_budget_ns || !n_pixels)
+		return;
+
+	const double ns_per_pixel = (double)ns / n_pixels;
+	if (src->analysis_ns_per_pixel > 0.0)
+		src->analysis_ns_per_pixel += (ns_per_pixel - src->analysis_ns_per_pixel) * ANALYSIS_TIME_SMOOTHING;
+	else
+		src->analysis_ns_per_pixel = ns_per_pixel;
+
+	const double scale = (double)os_atomic_load_long(&src->auto_scale) / CM_SCALE_ONE;
+	const double budget_pixels = (double)src->scale_budget_ns / src->analysis_ns_per_pixel;
+	set_auto_scale(src, scale * sqrt((double)n_pixels / budget_pixels));
+}
+
+/*
+ * The frames are selected by the video frame time so that the shared captures and the scopes agree,
+ * and each source has its own phase so that the decimated scopes do not analyze the same frame.
+ */
+bool cm_is_analysis_frame(struct cm_source *src, uint64_t frame_time)
+{
+	// The overlays drawing the texture have to follow the image.
+	if (src->analysis_rate <= 0.0 || src->bypass || (src->flags & CM_FLAG_RAW_TEXTURE))
+		return true;
+
+	struct obs_video_info ovi;
+	if (!obs_get_video_info(&ovi) || !ovi.fps_num || !ovi.fps_den)
+		return true;
+
+	const double fps = (double)ovi.fps_num / ovi.fps_den;
+	const uint64_t period = (uint64_t)ceil(fps / src->analysis_rate - 1e-6);
+	if (period <= 1)
+		return true;
+
+	// The graphics thread and the raw video output thread may both call this while switching.
+	long phase = os_atomic_load_long(&src->analysis_phase);
+	if (!phase) {
+		os_atomic_compare_swap_long(&src->analysis_phase, 0, os_atomic_inc_long(&n_analysis_phases));
+		phase = os_atomic_load_long(&src->analysis_phase);
+	}
+
+	const uint64_t frame = (uint64_t)((double)frame_time * fps / 1e9 + 0.5);
+	return (frame + (uint64_t)phase) % period == 0;
+}
+
+/*
+ * Returns the height of the bands. All bands but the last one have this height so that each item keeps one
+ * stage surface. The height is even so that the bands split the 4:2:0 chroma rows.
+ */
+static uint32_t band_height(uint32_t height, uint32_t n_bands)
+{
+	return ((height + n_bands - 1) / n_bands + 1) & ~1u;
+}
+
+/* The item staged in the previous frame is old enough to be mapped without a stall.
+ * Map it here so that the pipeline thread does not need to enter the graphics context. */
+static void hand_staged_surface(struct cm_source *src)
+{
+	if (!src->write_queue_staged)
+		return;
+
+	map_stagesurface(src, &src->queue[src->i_write_queue]);
+	cm_queue_ready(src);
+	src->write_queue_staged = false;
+
+	// The pipeline thread has finished with the item or the item was dropped.
+	unmap_stagesurface(&src->queue[src->i_write_queue]);
+}
+
+void cm_queue_ready(struct cm_source *src)
+{
+	src->queue[src->i_write_queue].ready_ns = os_gettime_ns();
+	cm_trace_instant("queue_ready", src->i_write_queue);
+	long prev = os_atomic_exchange_long(&src->ready, src->i_write_queue | CM_QUEUE_FRESH);
+	if (prev & CM_QUEUE_FRESH) {
+		os_atomic_inc_long(&src->dropped_frames);
+		cm_stats_add_dropped(src);
+		cm_trace_instant("queue_drop", prev & CM_QUEUE_INDEX_MASK);
+	}
+	src->i_write_queue = (int)(prev & CM_QUEUE_INDEX_MASK);
+	os_event_signal(src->pipeline_event);
+}
+
+// Returns false if the frame is skipped by the analysis rate.
+static bool render_target(struct cm_source *src)
+{
+	if (src->rendered)
+		return true;
 
 	if (cm_is_roi(src)) {
+		src->rendered = 1;
 		// Call roi_target_render just in case ROI is not rendered.
 		roi_target_render(src->roi);
-		return;
+		return true;
+	}
+
+	if (src->tap) {
+		// The scope tap writes the queue.
+		src->rendered = 1;
+		return true;
+	}
+
+	if (src->capture) {
+		src->rendered = 1;
+		return render_target(&src->capture->cm);
+	}
+
+	if (src->raw_video) {
+		// The raw video output writes the queue.
+		src->rendered = 1;
+		return true;
 	}
 
+	if (!cm_is_analysis_frame(src, obs_get_video_frame_time())) {
+		// The scope keeps drawing the last result. Only the frame already staged goes to the pipeline.
+		hand_staged_surface(src);
+		return false;
+	}
+	src->rendered = 1;
+
 	obs_source_t *target = src->weak_target ? obs_weak_source_get_source(src->weak_target) : NULL;
-	if (!target && *src->target_name)
-		return;
+	if (!target && *src->target_name && !is_program_output_name(src->target_name))
+		return true;
 
 	uint32_t target_width, target_height;
 	if (target) {
@@ -246,26 +657,19 @@ void cm_render_target(struct cm_source *src)
 		target_width = ovi.base_width;
 		target_height = ovi.base_height;
 	}
-	uint32_t scaled_width = target_width / src->target_scale;
-	uint32_t scaled_height = target_height / src->target_scale;
+	const double scale = get_scale(src, target_width, target_height);
+	uint32_t scaled_width = (uint32_t)(target_width / scale);
+	uint32_t scaled_height = (uint32_t)(target_height / scale);
 	if (scaled_width <= 0 || scaled_height <= 0) {
 		obs_source_release(target);
-		return;
+		return true;
 	}
 
 	bool has_rgb = !src->bypass && (src->flags & CM_FLAG_CONVERT_RGB);
 	bool has_yuv = !src->bypass && (src->flags & CM_FLAG_CONVERT_YUV);
 	bool has_raw = src->bypass || (src->flags & CM_FLAG_RAW_TEXTURE);
 
-	if ((has_rgb || has_yuv) && src->i_write_queue == src->i_read_queue) {
-		pthread_mutex_lock(&src->pipeline_mutex);
-		src->i_staging_queue = -1;
-		pthread_cond_signal(&src->pipeline_cond);
-		pthread_mutex_unlock(&src->pipeline_mutex);
-
-		obs_source_release(target);
-		return;
-	}
+	hand_staged_surface(src);
 
 	PROFILE_START(prof_render_target_name);
 
@@ -281,72 +685,215 @@ void cm_render_target(struct cm_source *src)
 		cy = scaled_height;
 	}
 
-	uint32_t sheight = 0;
 	struct cm_surface_queue_item *item = &src->queue[src->i_write_queue];
-	if (has_rgb || has_raw) {
-		sheight += cy;
-	}
-	if (has_yuv) {
-		sheight += cy;
-	}
 	item->cb = src->callback;
 	item->cb_data = src->callback_data;
 	item->flags = src->bypass ? CM_FLAG_RAW_TEXTURE
 				  : src->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_YUV | CM_FLAG_RAW_TEXTURE);
 	item->colorspace = src->colorspace;
+	item->timestamp = obs_get_video_frame_time();
+	item->cpu_convert = 0;
+	get_uv_shift(src, item->flags, &item->uv_shift_x, &item->uv_shift_y);
+	if (cpu_yuv_conversion && (item->flags & CM_FLAG_CONVERT_RGB) && (item->flags & CM_FLAG_CONVERT_YUV)) {
+		// RGB is read back anyway; derive YUV from it instead of reading back YUV too.
+		// The subsampled chroma is still made by the GPU.
+		const bool uv_sub = item->uv_shift_x || item->uv_shift_y;
+		item->cpu_convert = item->flags & (uv_sub ? CM_FLAG_CONVERT_Y : CM_FLAG_CONVERT_YUV);
+		item->flags &= ~item->cpu_convert;
+	}
+
+	// Progressive readback; only a band of the rows is converted and staged in each frame.
+	item->band = 0;
+	item->n_bands = 1;
+	item->band_y0 = 0;
+	item->full_height = cy;
+	uint32_t surface_height = cy;
+	if (src->n_bands > 1 && !has_raw && cy >= (uint32_t)src->n_bands * 2) {
+		// The rounding can leave fewer bands than requested, eg. 10 rows in 4 bands of 4 rows.
+		surface_height = band_height(cy, (uint32_t)src->n_bands);
+		item->n_bands = (cy + surface_height - 1) / surface_height;
+		item->band = src->i_band % item->n_bands;
+		item->band_y0 = item->band * surface_height;
+		if (cy - item->band_y0 < surface_height)
+			cy -= item->band_y0;
+		else
+			cy = surface_height;
+	}
 
-	prepare_stagesurface(item, cx, cy, sheight);
+	layout_surface(item, cx, cy, surface_height);
 
 	if (!src->texrender)
 		src->texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
 
-	if (!render_target_to_texrender(target, target_width, target_height, src->texrender, scaled_width,
-					scaled_height)) {
+	uint64_t t = os_gettime_ns();
+	if (!render_scaled_target(src, target, scale, src->texrender, scaled_width, scaled_height)) {
 		obs_source_release(target);
-		return;
+		return true;
 	}
 	src->texrender_width = scaled_width;
 	src->texrender_height = scaled_height;
+	uint64_t t1 = os_gettime_ns();
+	cm_stats_add(src, CM_STAT_RENDER, t1 - t);
 
-	if (has_rgb || has_raw || has_yuv)
-		render_rgb_yuv(src, item, x, y);
+	if (has_rgb || has_raw || has_yuv) {
+		render_rgb_yuv(src, item, x, y + item->band_y0);
+		t = os_gettime_ns();
+		cm_stats_add(src, CM_STAT_CONVERT, t - t1);
+	}
 
 	PROFILE_END(prof_render_target_name);
 
 	if (has_rgb || has_yuv) {
 		PROFILE_START(prof_stage_surface_name);
+		t = os_gettime_ns();
 		gs_stage_texture(item->stagesurface, gs_texrender_get_texture(item->texrender));
+		cm_stats_add(src, CM_STAT_STAGE, os_gettime_ns() - t);
 		PROFILE_END(prof_stage_surface_name);
+		src->write_queue_staged = true;
+		src->i_band = item->band + 1;
 	}
 
-	pthread_mutex_lock(&src->pipeline_mutex);
-	src->i_staging_queue = src->i_write_queue;
-	src->i_write_queue = (src->i_write_queue + 1) % CM_SURFACE_QUEUE_SIZE;
-	if (has_rgb || has_yuv)
-		pthread_cond_signal(&src->pipeline_cond);
-	else
-		src->i_read_queue = (src->i_write_queue + CM_SURFACE_QUEUE_SIZE - 1) % CM_SURFACE_QUEUE_SIZE;
-	pthread_mutex_unlock(&src->pipeline_mutex);
-
 	if (target)
 		obs_source_release(target);
+	return true;
 }
 
-static void cm_pipeline_thread_loop(struct cm_surface_queue_item *item)
+void cm_render_target(struct cm_source *src)
 {
-	uint8_t *video_data;
-	uint32_t video_linesize;
+	src->last_render_ns = os_gettime_ns();
+	render_target(src);
+}
 
-	if (!(item->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_YUV)))
+struct convert_yuv_ctx
+{
+	const struct cm_surface_data *surface_data;
+	uint8_t *y_data, *uv_data;
+	bool bt601;
+};
+
+static void convert_yuv_band(void *data, uint32_t index, uint32_t n_bands)
+{
+	struct convert_yuv_ctx *ctx = data;
+	const struct cm_surface_data *sd = ctx->surface_data;
+	const uint32_t y0 = sd->height * index / n_bands;
+	const uint32_t y1 = sd->height * (index + 1) / n_bands;
+
+	cm_rgb_to_yuv(ctx->y_data ? ctx->y_data + sd->width * y0 : NULL, sd->width,
+		      ctx->uv_data ? ctx->uv_data + sd->width * 2 * y0 : NULL, sd->width * 2,
+		      sd->rgb_data + sd->linesize * y0, sd->linesize, sd->width, y1 - y0, ctx->bt601);
+}
+
+static void convert_yuv_on_cpu(struct cm_source *src, struct cm_surface_data *surface_data, uint32_t flags)
+{
+	const size_t n_pixels = (size_t)surface_data->width * surface_data->height;
+	const size_t y_size = flags & CM_FLAG_CONVERT_Y ? n_pixels : 0;
+	const size_t uv_size = flags & CM_FLAG_CONVERT_UV ? n_pixels * 2 : 0;
+
+	if (src->cpu_yuv_buf_size < y_size + uv_size) {
+		bfree(src->cpu_yuv_buf);
+		src->cpu_yuv_buf = bmalloc(y_size + uv_size);
+		src->cpu_yuv_buf_size = y_size + uv_size;
+	}
+
+	struct convert_yuv_ctx ctx = {
+		.surface_data = surface_data,
+		.y_data = y_size ? src->cpu_yuv_buf : NULL,
+		.uv_data = uv_size ? src->cpu_yuv_buf + y_size : NULL,
+		.bt601 = surface_data->colorspace == 1,
+	};
+	const uint32_t width = surface_data->width;
+	cm_worker_run(convert_yuv_band, &ctx,
+		      cm_worker_n_bands(surface_data->height, (CONVERT_BAND_MIN_PIXELS + width - 1) / width));
+
+	if (ctx.y_data) {
+		surface_data->y_data = ctx.y_data;
+		surface_data->y_linesize = width;
+	}
+	if (ctx.uv_data) {
+		surface_data->u_data = ctx.uv_data;
+		surface_data->v_data = ctx.uv_data + 1;
+		surface_data->uv_linesize = width * 2;
+		surface_data->uv_step = 2;
+		surface_data->uv_shift_x = 0;
+		surface_data->uv_shift_y = 0;
+	}
+}
+
+/*
+ * Returns true if the item is same as the previously analyzed item.
+ * The whole surface is fingerprinted so that all planes and the layout are covered.
+ */
+static bool is_static_frame(struct cm_source *src, const struct cm_surface_queue_item *item)
+{
+	uint64_t fp;
+	if (item->n_bands > 1) {
+		// The item has the last band; the assembled frame is fingerprinted.
+		fp = cm_band_assembly_fingerprint(&src->bands, FINGERPRINT_ROW_STEP);
+	} else if (item->flags & CM_FLAG_RAW_VIDEO) {
+		// The planes are packed in `raw_data`, whose size is a multiple of the width.
+		fp = cm_fingerprint(item->raw_data, item->width, item->width, (uint32_t)(item->raw_size / item->width),
+				    FINGERPRINT_ROW_STEP);
+	} else {
+		fp = cm_fingerprint(item->video_data, item->video_linesize, item->swidth * 4, item->sheight,
+				    FINGERPRINT_ROW_STEP);
+	}
+	fp = cm_fingerprint_mix(fp, (uint64_t)item->width << 32 | item->height);
+	fp = cm_fingerprint_mix(fp, (uint64_t)item->flags << 32 | item->cpu_convert);
+	fp = cm_fingerprint_mix(fp, (uint64_t)item->uv_shift_x << 32 | item->uv_shift_y);
+	fp = cm_fingerprint_mix(fp, (uint64_t)item->colorspace);
+	fp = cm_fingerprint_mix(fp, (uint64_t)(uintptr_t)item->cb_data);
+
+	const uint64_t now = os_gettime_ns();
+	const bool refresh = os_atomic_set_bool(&src->refresh_requested, false);
+	if (!refresh && fp == src->last_fingerprint && now - src->last_analyzed_ns < STATIC_REFRESH_NS)
+		return true;
+
+	src->last_fingerprint = fp;
+	src->last_analyzed_ns = now;
+	return false;
+}
+
+static void analyze_surface(struct cm_source *src, struct cm_surface_queue_item *item,
+			    struct cm_surface_data *surface_data)
+{
+	const uint64_t t_start = os_gettime_ns();
+	cm_stats_add(src, CM_STAT_LATENCY, t_start - item->ready_ns);
+
+	if (skip_static_frames && is_static_frame(src, item)) {
+		cm_stats_add_static(src);
+		cm_trace_instant("static_frame", src->i_read_queue);
 		return;
+	}
 
-	obs_enter_graphics();
-	PROFILE_START(prof_stagesurface_map_name);
-	bool ret = gs_stagesurface_map(item->stagesurface, &video_data, &video_linesize);
-	PROFILE_END(prof_stagesurface_map_name);
-	obs_leave_graphics();
+	if (item->cpu_convert && surface_data->rgb_data && surface_data->width) {
+		PROFILE_START(prof_convert_yuv_cpu_name);
+		convert_yuv_on_cpu(src, surface_data, item->cpu_convert);
+		cm_stats_add(src, CM_STAT_CONVERT_CPU, os_gettime_ns() - t_start);
+		PROFILE_END(prof_convert_yuv_cpu_name);
+	}
+
+	if (item->cb) {
+		cm_deliver_surface(src, surface_data);
+	}
+
+	const uint64_t n_pixels = (uint64_t)surface_data->width * surface_data->height;
+	update_time_budget_scale(src, os_gettime_ns() - t_start, n_pixels);
+}
+
+static void cm_pipeline_thread_loop(struct cm_source *src, struct cm_surface_queue_item *item)
+{
+	if (item->flags & CM_FLAG_RAW_VIDEO) {
+		if (item->raw_data)
+			analyze_surface(src, item, &item->raw_sd);
+		return;
+	}
+
+	if (!(item->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_YUV)))
+		return;
 
-	if (!ret)
+	uint8_t *video_data = item->video_data;
+	const uint32_t video_linesize = item->video_linesize;
+	if (!video_data)
 		return;
 
 	struct cm_surface_data surface_data = {
@@ -354,22 +901,33 @@ static void cm_pipeline_thread_loop(struct cm_surface_queue_item *item)
 		.width = item->width,
 		.height = item->height,
 		.colorspace = item->colorspace,
+		.timestamp = item->timestamp,
+		.y_linesize = video_linesize,
+		.uv_linesize = video_linesize,
+		.uv_step = 2,
+		.uv_shift_x = item->uv_shift_x,
+		.uv_shift_y = item->uv_shift_y,
 	};
 	if (item->flags & CM_FLAG_CONVERT_RGB) {
 		surface_data.rgb_data = video_data;
-		video_data += video_linesize * item->height;
 	}
-	if (item->flags & CM_FLAG_CONVERT_YUV) {
-		surface_data.yuv_data = video_data;
+	if (item->flags & CM_FLAG_CONVERT_Y) {
+		surface_data.y_data = video_data + video_linesize * item->yuv_y + item->y_x * 4;
+	}
+	if (item->flags & CM_FLAG_CONVERT_UV) {
+		surface_data.u_data = video_data + video_linesize * item->yuv_y + item->uv_x * 4;
+		surface_data.v_data = surface_data.u_data + 1;
 	}
 
-	if (item->cb) {
-		item->cb(item->cb_data, &surface_data);
+	if (item->n_bands > 1) {
+		// The frame is analyzed when all the bands have been read back.
+		if (!cm_band_assembly_add(&src->bands, &surface_data, item->band_y0, item->full_height, item->band,
+					  item->n_bands))
+			return;
+		surface_data = src->bands.sd;
 	}
 
-	obs_enter_graphics();
-	gs_stagesurface_unmap(item->stagesurface);
-	obs_leave_graphics();
+	analyze_surface(src, item, &surface_data);
 }
 
 static void *cm_pipeline_thread(void *data)
@@ -379,25 +937,29 @@ static void *cm_pipeline_thread(void *data)
 
 	os_set_thread_name("color-monitor");
 
-	pthread_mutex_lock(&src->pipeline_mutex);
+	struct dstr name = {0};
+	dstr_printf(&name, "color-monitor '%s'", src->self ? obs_source_get_name(src->self) : "(shared)");
+	cm_trace_set_thread_name(name.array);
+	dstr_free(&name);
+
 	while (!src->request_exit) {
-		int next = (src->i_read_queue + 1) % CM_SURFACE_QUEUE_SIZE;
-		if (src->i_write_queue == next || src->i_staging_queue == next) {
-			pthread_cond_wait(&src->pipeline_cond, &src->pipeline_mutex);
+		if (!(os_atomic_load_long(&src->ready) & CM_QUEUE_FRESH)) {
+			os_event_wait(src->pipeline_event);
 			continue;
 		}
 
-		src->i_read_queue = next;
-		pthread_mutex_unlock(&src->pipeline_mutex);
+		// Only this thread clears CM_QUEUE_FRESH so that the exchanged item is always fresh.
+		long prev = os_atomic_exchange_long(&src->ready, src->i_read_queue);
+		src->i_read_queue = (int)(prev & CM_QUEUE_INDEX_MASK);
+		cm_trace_instant("queue_take", src->i_read_queue);
 
 		PROFILE_START(prof_pipeline_thread);
-		cm_pipeline_thread_loop(&src->queue[src->i_read_queue]);
+		cm_pipeline_thread_loop(src, &src->queue[src->i_read_queue]);
 		PROFILE_END(prof_pipeline_thread);
-		pthread_mutex_lock(&src->pipeline_mutex);
 	}
-	pthread_mutex_unlock(&src->pipeline_mutex);
 
 	blog(LOG_DEBUG, "leaving cm_pipeline_thread data=%p", data);
+	cm_trace_thread_exit();
 
 	return NULL;
 }
@@ -427,21 +989,19 @@ void cm_bypass_render(struct cm_source *src)
 	}
 }
 
-static void stop_pipeline_thread(struct cm_source *src)
+void cm_stop_pipeline_thread(struct cm_source *src)
 {
 	if (!src->pipeline_thread_running)
 		return;
 
-	pthread_mutex_lock(&src->pipeline_mutex);
 	src->request_exit = true;
-	pthread_cond_signal(&src->pipeline_cond);
-	pthread_mutex_unlock(&src->pipeline_mutex);
+	os_event_signal(src->pipeline_event);
 
 	pthread_join(src->pipeline_thread, NULL);
 	src->pipeline_thread_running = false;
 }
 
-static void start_pipeline_thread(struct cm_source *src)
+void cm_start_pipeline_thread(struct cm_source *src)
 {
 	if (src->pipeline_thread_running)
 		return;
@@ -530,7 +1090,7 @@ static bool update_target_unlocked(struct cm_source *src)
 	if (!src->target_name)
 		return false;
 
-	if (is_program_name(src->target_name))
+	if (is_program_name(src->target_name) || is_program_output_name(src->target_name))
 		return update_target_unlocked_program(src);
 
 	if (is_mainview_name(src->target_name))
@@ -572,6 +1132,175 @@ static void update_roi_src(struct cm_source *src)
 	roi_register_source(src->roi, src);
 }
 
+static void release_scope_tap(struct cm_source *src)
+{
+	if (src->tap)
+		scope_tap_unregister_source(src->tap, src);
+
+	src->tap = NULL;
+
+	if (src->tap_src) {
+		obs_source_release(src->tap_src);
+		src->tap_src = NULL;
+	}
+}
+
+// The scopes that draw the texture of the target cannot use the frames of the scope tap.
+static bool uses_scope_tap(const struct cm_source *src)
+{
+	if (src->bypass || (src->flags & (CM_FLAG_RAW_TEXTURE | CM_FLAG_ROI)))
+		return false;
+	return src->weak_target && !src->roi;
+}
+
+/*
+ * Registers to the enabled scope tap on the target, or unregisters if the tap was removed.
+ * Returns true if the scope tap writes the frames.
+ */
+static bool update_scope_tap(struct cm_source *src)
+{
+	struct scope_tap *tap = NULL;
+	obs_source_t *tap_src = NULL;
+	if (uses_scope_tap(src)) {
+		obs_source_t *target = obs_weak_source_get_source(src->weak_target);
+		tap_src = scope_tap_find(target, &tap);
+		obs_source_release(target);
+	}
+	if (tap && !scope_tap_can_serve(tap, src->flags)) {
+		obs_source_release(tap_src);
+		tap_src = NULL;
+		tap = NULL;
+	}
+
+	if (tap == src->tap) {
+		obs_source_release(tap_src);
+		return !!tap;
+	}
+
+	release_scope_tap(src);
+	if (!tap)
+		return false;
+
+	// Stop the other writers first so that the callback is not called from two threads.
+	release_capture(src);
+	cm_stop_pipeline_thread(src);
+	src->tap_src = tap_src;
+	src->tap = tap;
+	scope_tap_register_source(tap, src);
+	return true;
+}
+
+static void release_capture(struct cm_source *src)
+{
+	if (!src->capture)
+		return;
+
+	// get_stats reads the pointer under target_update_mutex.
+	pthread_mutex_lock(&src->target_update_mutex);
+	struct cm_capture *capture = src->capture;
+	src->capture = NULL;
+	pthread_mutex_unlock(&src->target_update_mutex);
+
+	cm_capture_release(capture, src);
+}
+
+// The scopes that draw the texture of the target, or analyze RGB, render Program instead.
+static bool uses_raw_video(const struct cm_source *src)
+{
+	if (src->bypass || (src->flags & (CM_FLAG_RAW_TEXTURE | CM_FLAG_ROI)))
+		return false;
+	// RGB is not derived from the YUV frames.
+	if (src->flags & CM_FLAG_CONVERT_RGB)
+		return false;
+	return is_program_output_name(src->target_name);
+}
+
+// The raw video output and the graphics thread write the same queue items; no item stays mapped across them.
+static void unmap_queue(struct cm_source *src)
+{
+	obs_enter_graphics();
+	for (int i = 0; i < CM_SURFACE_QUEUE_SIZE; i++)
+		unmap_stagesurface(&src->queue[i]);
+	obs_leave_graphics();
+}
+
+static void release_raw_video(struct cm_source *src)
+{
+	if (!src->raw_video)
+		return;
+
+	cm_raw_video_release(src);
+
+	// The graphics thread writes the queue again.
+	cm_stop_pipeline_thread(src);
+	unmap_queue(src);
+}
+
+static void update_raw_video(struct cm_source *src)
+{
+	struct obs_video_info ovi;
+	if (!obs_get_video_info(&ovi))
+		return;
+
+	// The items staged by the graphics thread are abandoned; the raw video output writes the queue.
+	// The pipeline thread is stopped so that it does not read an item while it is unmapped.
+	if (!src->raw_video) {
+		cm_stop_pipeline_thread(src);
+		unmap_queue(src);
+	}
+	src->write_queue_staged = false;
+
+	const double scale = get_scale(src, ovi.output_width, ovi.output_height);
+	cm_raw_video_update(src, (uint32_t)(ovi.output_width / scale), (uint32_t)(ovi.output_height / scale));
+}
+
+static void update_capture(struct cm_source *src)
+{
+	if (src->capture && cm_capture_match(src->capture, src))
+		return;
+
+	release_capture(src);
+
+	// Stop the own thread first so that the callback is not called from two threads.
+	cm_stop_pipeline_thread(src);
+	struct cm_capture *capture = cm_capture_get(src);
+	pthread_mutex_lock(&src->target_update_mutex);
+	src->capture = capture;
+	pthread_mutex_unlock(&src->target_update_mutex);
+}
+
+/*
+ * Returns true if the scope is drawn by anything.
+ * A scope on a dock is a private source, which is not counted by `obs_source_showing`, so that
+ * whether `video_render` was called recently is also checked.
+ * The shared capture has no source and is held only while its consumers are visible.
+ */
+static bool is_visible(const struct cm_source *src)
+{
+	if (!src->self)
+		return true;
+	if (os_gettime_ns() - src->last_render_ns < VISIBLE_TIMEOUT_NS)
+		return true;
+	return obs_source_showing(src->self);
+}
+
+// Renders a hidden scope at the rate of `hidden_render_interval_ns` to keep the analysis alive.
+static void render_hidden(struct cm_source *src)
+{
+	const uint64_t now = os_gettime_ns();
+	if (now - src->hidden_render_ns < hidden_render_interval_ns)
+		return;
+
+	obs_enter_graphics();
+	gs_blend_state_push();
+	gs_reset_blend_state();
+	// A frame skipped by the analysis rate is retried at the next tick.
+	if (render_target(src))
+		src->hidden_render_ns = now;
+	gs_blend_state_pop();
+	obs_leave_graphics();
+}
+
 void cm_tick(void *data, float unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -584,14 +1313,51 @@ void cm_tick(void *data, float unused)
 	}
 	pthread_mutex_unlock(&src->target_update_mutex);
 
-	if (src->roi && src->roi_src)
-		stop_pipeline_thread(src);
-	else if (!src->roi && (is_program_name(src->target_name) || src->weak_target))
-		start_pipeline_thread(src);
+	const bool visible = is_visible(src);
+
+	if (!uses_raw_video(src))
+		release_raw_video(src);
+
+	if (!visible && !hidden_render_interval_ns) {
+		// Nothing draws the scope. The capture and the thread come back when the scope is rendered.
+		release_capture(src);
+		release_raw_video(src);
+		release_scope_tap(src);
+		cm_stop_pipeline_thread(src);
+	} else if (src->roi && src->roi_src) {
+		release_scope_tap(src);
+		release_capture(src);
+		cm_stop_pipeline_thread(src);
+	} else if (update_scope_tap(src)) {
+		release_capture(src);
+		cm_stop_pipeline_thread(src);
+	} else if (uses_raw_video(src)) {
+		release_capture(src);
+		update_raw_video(src);
+		cm_start_pipeline_thread(src);
+	} else if (!src->roi && (is_program_name(src->target_name) || is_program_output_name(src->target_name) ||
+				 src->weak_target)) {
+		if (cm_capture_shareable(src)) {
+			update_capture(src);
+			cm_tick(&src->capture->cm, unused);
+		} else {
+			release_capture(src);
+			cm_start_pipeline_thread(src);
+		}
+	}
+
+	// The pyramid is held only while the scope renders the target by itself.
+	if ((!visible && !hidden_render_interval_ns) || src->roi || src->tap || src->raw_video || src->capture)
+		release_pyramid(src);
+
+	cm_stats_tick(src);
 
 	src->rendered = 0;
 
-	src->i_bypass_queue = (src->i_write_queue + CM_SURFACE_QUEUE_SIZE - 1) % CM_SURFACE_QUEUE_SIZE;
+	src->i_bypass_queue = src->i_write_queue;
+
+	if (!visible && hidden_render_interval_ns)
+		render_hidden(src);
 }
 
 uint32_t cm_bypass_get_width(struct cm_source *src)
@@ -612,6 +1378,22 @@ gs_texture_t *cm_bypass_get_texture(struct cm_source *src)
 	return gs_texrender_get_texture(item->texrender);
 }
 
+void cm_request_refresh(struct cm_source *src)
+{
+	os_atomic_set_bool(&src->refresh_requested, true);
+
+	// The frames come from the shared capture, the ROI, or the scope tap, which skip the static frames by
+	// themselves.
+	pthread_mutex_lock(&src->target_update_mutex);
+	if (src->capture)
+		os_atomic_set_bool(&src->capture->cm.refresh_requested, true);
+	if (src->roi)
+		os_atomic_set_bool(&src->roi->cm.refresh_requested, true);
+	if (src->tap)
+		os_atomic_set_bool(&src->tap->cm.refresh_requested, true);
+	pthread_mutex_unlock(&src->target_update_mutex);
+}
+
 void cm_request(struct cm_source *src, cm_surface_cb_t callback, void *data)
 {
 	// Should be called from the graphics thread or before start to operate.
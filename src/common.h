@@ -1,6 +1,8 @@
 #pragma once
 
 #include <util/threading.h>
+#include "surface-data.h"
+#include "band-assembly.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +13,12 @@ static inline bool is_program_name(const char *name)
 	return name && name[0] == 0;
 }
 
+// Program as converted for the outputs, see raw-video.h
+static inline bool is_program_output_name(const char *name)
+{
+	return name && name[0] == 0x02 && name[1] == 0;
+}
+
 static inline bool is_mainview_name(const char *name)
 {
 	return name && name[0] == 0x01 && name[1] == 0;
@@ -21,29 +29,46 @@ static inline bool is_preview_name(const char *name)
 	return name && name[0] == 0x10 && name[1] == 0;
 }
 
-struct cm_surface_data
-{
-	uint8_t *rgb_data, *yuv_data;
-	uint32_t linesize, width, height;
-	int colorspace;
-	gs_texture_t *tex; // for bypass mode
-};
-
 typedef void (*cm_surface_cb_t)(void *data, struct cm_surface_data *surface_data);
 
 struct cm_surface_queue_item
 {
 	gs_texrender_t *texrender;
 	gs_stagesurf_t *stagesurface;
-	uint32_t width, height, sheight;
+	uint32_t width, height, swidth, sheight;
+	uint32_t y_x, uv_x, yuv_y; // position of the packed Y and UV planes in texels
+	uint32_t uv_shift_x, uv_shift_y; // subsampling of the UV plane made by the GPU
+	uint32_t band, n_bands; // progressive readback; the surface has the band `band` of `n_bands`
+	uint32_t band_y0, full_height; // first row of the band in the frame of `full_height` rows
 	uint32_t flags; // RGB or YUV
+	uint32_t cpu_convert; // Y and/or UV planes converted from RGB by the pipeline thread
 	int colorspace;
 
+	// mapped by the graphics thread, unmapped when the item comes back to the graphics thread
+	uint8_t *video_data;
+	uint32_t video_linesize;
+
+	// frame of the raw video output or the scope tap, owned by the item; `raw_sd` points into `raw_data`
+	uint8_t *raw_data;
+	size_t raw_size;
+	struct cm_surface_data raw_sd;
+
+	uint64_t timestamp; // video frame time in ns
+	uint64_t ready_ns; // os_gettime_ns when the item was made ready for the pipeline thread
+
 	cm_surface_cb_t cb;
 	void *cb_data;
 };
 
+/*
+ * The queue is a triple buffer.
+ * The graphics thread owns `queue[i_write_queue]`, the pipeline thread owns `queue[i_read_queue]`,
+ * and the remaining item is exchanged through `ready` by atomic operations so that neither thread
+ * waits for the other.
+ */
 #define CM_SURFACE_QUEUE_SIZE 3
+#define CM_QUEUE_INDEX_MASK 0x3
+#define CM_QUEUE_FRESH 0x4 // the item in `ready` has not been read by the pipeline thread
 
 struct cm_source
 {
@@ -51,26 +76,50 @@ struct cm_source
 
 	// graphics
 	struct cm_surface_queue_item queue[CM_SURFACE_QUEUE_SIZE];
-	volatile int i_write_queue, i_staging_queue;
-	volatile int i_read_queue;
+	int i_write_queue; // graphics thread
+	bool write_queue_staged;
+	volatile long ready; // index and CM_QUEUE_FRESH
+	int i_read_queue; // pipeline thread
+	volatile long dropped_frames;
 	int i_bypass_queue;
 	gs_texrender_t *texrender;
 	uint32_t texrender_width, texrender_height;
+	struct cm_pyramid *pyramid; // shared render of the target, see render-pyramid.h
 	gs_effect_t *effect;
 	bool rendered;
+	uint64_t last_render_ns; // os_gettime_ns when cm_render_target was called
+	uint64_t hidden_render_ns; // os_gettime_ns when the hidden scope was rendered by cm_tick
+	uint32_t i_band; // the band staged next in the progressive readback
 	int x0, x1, y0, y1; // for ROI
 
 	// threading
 	pthread_t pipeline_thread;
-	pthread_mutex_t pipeline_mutex;
-	pthread_cond_t pipeline_cond;
+	os_event_t *pipeline_event;
 	volatile bool pipeline_thread_running;
 	volatile bool request_exit;
+	uint8_t *cpu_yuv_buf; // pipeline thread
+	size_t cpu_yuv_buf_size;
+	struct cm_band_assembly bands; // pipeline thread
+
+	// skipping static frames, pipeline thread
+	uint64_t last_fingerprint;
+	uint64_t last_analyzed_ns;
+	volatile bool refresh_requested;
 
 	// upper layer
 	cm_surface_cb_t callback;
 	void *callback_data;
 
+	// recording and replay, see frame-replay.h
+	pthread_mutex_t callback_mutex;
+	struct cm_frame_writer *record_writer; // protected by callback_mutex
+	pthread_mutex_t replay_mutex;
+	struct cm_replay *replay; // protected by replay_mutex
+	volatile bool replaying;
+
+	// see source-stats.h
+	struct cm_source_stats *stats;
+
 	bool enumerating; // not thread safe but I have no other idea.
 
 	// target
@@ -78,23 +127,55 @@ struct cm_source
 	obs_weak_source_t *weak_target;
 	obs_source_t *roi_src;
 	struct roi_source *roi;
+	obs_source_t *tap_src;
+	struct scope_tap *tap;
+	struct cm_capture *capture;
+	struct cm_raw_video *raw_video; // graphics thread
 	char *target_name;
 
 	// properties
 	int target_scale;
+	int scale_mode; // CM_SCALE_*
+	uint64_t scale_budget_ns;
+	uint64_t scale_budget_pixels;
+	double analysis_rate; // in Hz, 0 to analyze every frame
+	int chroma_subsampling; // CM_CHROMA_*
+	int n_bands; // the frame is read back in this number of bands over as many frames
+	volatile long analysis_phase; // offset of the analyzed frames, assigned at the first decimated frame
+
+	// automatic scale
+	volatile long auto_scale; // in 1/CM_SCALE_ONE, written by the thread controlling the scale
+	double analysis_ns_per_pixel; // pipeline thread
 	int colorspace; // get from ovi if auto
 	uint32_t flags;
 	bool bypass;
 };
 
 #define CM_FLAG_CONVERT_RGB 1
-#define CM_FLAG_CONVERT_YUV 2
+#define CM_FLAG_CONVERT_Y 2
 #define CM_FLAG_RAW_TEXTURE 4
 #define CM_FLAG_ROI 8
+#define CM_FLAG_SHARED 16
+#define CM_FLAG_CONVERT_UV 32
+#define CM_FLAG_CONVERT_YUV (CM_FLAG_CONVERT_Y | CM_FLAG_CONVERT_UV)
+#define CM_FLAG_RAW_VIDEO 64 // the item has a frame in `raw_data` instead of the stage surface
+
+#define CM_SCALE_MANUAL 0
+#define CM_SCALE_TIME 1 // keeps the analysis time per frame within `scale_budget_ns`
+#define CM_SCALE_PIXELS 2 // keeps the number of analyzed pixels within `scale_budget_pixels`
+#define CM_SCALE_ONE 256
+
+#define CM_CHROMA_AUTO 0 // 4:2:0 if only U and V are analyzed, otherwise 4:4:4
+#define CM_CHROMA_444 1
+#define CM_CHROMA_422 2
+#define CM_CHROMA_420 3
+
+#define CM_READBACK_MAX_BANDS 8
 
 void cm_create(struct cm_source *src, obs_data_t *settings, obs_source_t *source);
 void cm_destroy(struct cm_source *src);
 void cm_update(struct cm_source *src, obs_data_t *settings);
+void cm_get_defaults(obs_data_t *settings);
 void cm_enum_sources(void *data, obs_source_enum_proc_t enum_callback, void *param);
 void cm_get_properties(struct cm_source *src, obs_properties_t *props);
 void cm_render_target(struct cm_source *src);
@@ -105,6 +186,34 @@ void cm_tick(void *data, float unused);
 
 void cm_request(struct cm_source *src, cm_surface_cb_t callback, void *data);
 
+// For a source whose queue is written outside of the graphics thread and not ticked by cm_tick, see scope-tap.h.
+void cm_start_pipeline_thread(struct cm_source *src);
+void cm_stop_pipeline_thread(struct cm_source *src);
+
+/*
+ * Gives `queue[i_write_queue]` to the pipeline thread and takes another item to write.
+ * Called by the thread writing the queue.
+ */
+void cm_queue_ready(struct cm_source *src);
+
+// Returns false if the frame at `frame_time` is skipped by the analysis rate.
+bool cm_is_analysis_frame(struct cm_source *src, uint64_t frame_time);
+
+// If enabled, YUV is converted on the CPU instead of reading back both RGB and YUV from the GPU.
+void cm_set_cpu_yuv_conversion(bool enable);
+
+// If enabled, a frame identical to the previous frame is not given to the callback.
+void cm_set_skip_static_frames(bool enable);
+
+// The next frame is given to the callback even if the frame is static, eg. the settings of the scope have changed.
+void cm_request_refresh(struct cm_source *src);
+
+/*
+ * Sets the rate in Hz at which a scope that is not displayed is still analyzed.
+ * If 0, the capture and the pipeline thread of the hidden scope are stopped.
+ */
+void cm_set_hidden_scope_rate(int rate);
+
 uint32_t cm_bypass_get_width(struct cm_source *src);
 uint32_t cm_bypass_get_height(struct cm_source *src);
 gs_texture_t *cm_bypass_get_texture(struct cm_source *src);
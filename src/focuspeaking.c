@@ -7,15 +7,9 @@
 #include "obs-convenience.h"
 #include "common.h"
 #include "util.h"
+#include "trace.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "focuspeaking_render";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
 #define DEFAULT_PEAKING_COLOR 0xFFFF5400 // ABGR
 #define DEFAULT_PEAKING_THRESHOLD 0.05
@@ -127,6 +121,7 @@ static void fpf_update(void *data, obs_data_t *settings)
 
 static void fp_get_defaults(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "peaking_color", DEFAULT_PEAKING_COLOR);
 	obs_data_set_default_double(settings, "peaking_threshold", DEFAULT_PEAKING_THRESHOLD);
 }
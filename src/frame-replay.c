@@ -0,0 +1,239 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "common.h"
+#include "frame-record.h"
+#include "frame-replay.h"
+#include "source-stats.h"
+#include "trace.h"
+
+struct cm_replay
+{
+	struct cm_source *src;
+	char *path;
+	bool realtime;
+
+	pthread_t thread;
+	volatile bool request_exit;
+	os_event_t *exit_event; // signaled by stop_replay to interrupt the wait for the next frame
+};
+
+static const char *source_name(const struct cm_source *src)
+{
+	return src->self ? obs_source_get_name(src->self) : "(shared)";
+}
+
+void cm_deliver_surface(struct cm_source *src, struct cm_surface_data *surface_data)
+{
+	cm_trace_begin("deliver");
+	pthread_mutex_lock(&src->callback_mutex);
+
+	if (src->record_writer && !cm_frame_writer_write(src->record_writer, surface_data)) {
+		blog(LOG_ERROR, "'%s': failed to write a frame, stopping recording", source_name(src));
+		cm_frame_writer_close(src->record_writer);
+		src->record_writer = NULL;
+	}
+
+	if (!src->replaying && src->callback) {
+		const uint64_t t = os_gettime_ns();
+		src->callback(src->callback_data, surface_data);
+		cm_stats_add(src, CM_STAT_CALLBACK, os_gettime_ns() - t);
+	}
+
+	pthread_mutex_unlock(&src->callback_mutex);
+	cm_trace_end("deliver");
+}
+
+static void start_recording(struct cm_source *src, const char *path)
+{
+	struct cm_frame_writer *w = cm_frame_writer_open(path);
+	if (!w) {
+		blog(LOG_ERROR, "'%s': failed to open '%s' to record frames", source_name(src), path);
+		return;
+	}
+
+	pthread_mutex_lock(&src->callback_mutex);
+	struct cm_frame_writer *prev = src->record_writer;
+	src->record_writer = w;
+	pthread_mutex_unlock(&src->callback_mutex);
+
+	cm_frame_writer_close(prev);
+	blog(LOG_INFO, "'%s': started recording frames to '%s'", source_name(src), path);
+}
+
+static void stop_recording(struct cm_source *src)
+{
+	pthread_mutex_lock(&src->callback_mutex);
+	struct cm_frame_writer *w = src->record_writer;
+	src->record_writer = NULL;
+	pthread_mutex_unlock(&src->callback_mutex);
+
+	if (w) {
+		cm_frame_writer_close(w);
+		blog(LOG_INFO, "'%s': stopped recording frames", source_name(src));
+	}
+}
+
+// Returns false if the replay is stopped before `t`.
+static bool wait_until(struct cm_replay *rp, uint64_t t)
+{
+	const uint64_t now = os_gettime_ns();
+	if (t <= now)
+		return !rp->request_exit;
+
+	// Wait whole milliseconds on the event, then sleep for the rest.
+	const uint64_t ms = (t - now) / 1000000;
+	if (ms && os_event_timedwait(rp->exit_event, (unsigned long)ms) == 0)
+		return false;
+	os_sleepto_ns(t);
+	return !rp->request_exit;
+}
+
+static void *replay_thread(void *data)
+{
+	struct cm_replay *rp = data;
+	struct cm_source *src = rp->src;
+
+	os_set_thread_name("color-monitor-replay");
+	cm_trace_set_thread_name("color-monitor-replay");
+
+	struct cm_frame_reader *r = cm_frame_reader_open(rp->path);
+	if (!r) {
+		blog(LOG_ERROR, "'%s': failed to open '%s' to replay frames", source_name(src), rp->path);
+		cm_trace_thread_exit();
+		return NULL;
+	}
+
+	const uint32_t n_frames = cm_frame_reader_count(r);
+	const uint64_t t_start = os_gettime_ns();
+	uint64_t ts_start = 0;
+	uint32_t i;
+
+	src->replaying = true;
+	for (i = 0; i < n_frames && !rp->request_exit; i++) {
+		struct cm_surface_data surface_data;
+		if (!cm_frame_reader_get(r, i, &surface_data))
+			break;
+
+		if (rp->realtime) {
+			if (i == 0)
+				ts_start = surface_data.timestamp;
+			else if (surface_data.timestamp > ts_start &&
+				 !wait_until(rp, t_start + (surface_data.timestamp - ts_start)))
+				break;
+		}
+
+		pthread_mutex_lock(&src->callback_mutex);
+		if (src->callback) {
+			const uint64_t t = os_gettime_ns();
+			src->callback(src->callback_data, &surface_data);
+			cm_stats_add(src, CM_STAT_CALLBACK, os_gettime_ns() - t);
+		}
+		pthread_mutex_unlock(&src->callback_mutex);
+	}
+	src->replaying = false;
+
+	const double elapsed = (double)(os_gettime_ns() - t_start) * 1e-9;
+	blog(LOG_INFO, "'%s': replayed %u of %u frames from '%s' in %.3f s (%.1f fps)", source_name(src), i,
+	     n_frames, rp->path, elapsed, elapsed > 0.0 ? i / elapsed : 0.0);
+
+	cm_frame_reader_close(r);
+	cm_trace_thread_exit();
+	return NULL;
+}
+
+static void stop_replay(struct cm_source *src)
+{
+	struct cm_replay *rp = src->replay;
+	if (!rp)
+		return;
+
+	rp->request_exit = true;
+	os_event_signal(rp->exit_event);
+	pthread_join(rp->thread, NULL);
+	src->replay = NULL;
+
+	os_event_destroy(rp->exit_event);
+	bfree(rp->path);
+	bfree(rp);
+}
+
+static void start_replay(struct cm_source *src, const char *path, bool realtime)
+{
+	stop_replay(src);
+
+	struct cm_replay *rp = bzalloc(sizeof(struct cm_replay));
+	rp->src = src;
+	rp->path = bstrdup(path);
+	rp->realtime = realtime;
+
+	if (os_event_init(&rp->exit_event, OS_EVENT_TYPE_MANUAL) != 0 ||
+	    pthread_create(&rp->thread, NULL, replay_thread, rp) != 0) {
+		blog(LOG_ERROR, "'%s': failed to create a thread to replay frames", source_name(src));
+		os_event_destroy(rp->exit_event);
+		bfree(rp->path);
+		bfree(rp);
+		return;
+	}
+
+	src->replay = rp;
+}
+
+static void cb_start_frame_recording(void *data, calldata_t *cd)
+{
+	const char *path = calldata_string(cd, "path");
+	if (path && *path)
+		start_recording(data, path);
+}
+
+static void cb_stop_frame_recording(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(cd);
+	stop_recording(data);
+}
+
+static void cb_start_frame_replay(void *data, calldata_t *cd)
+{
+	struct cm_source *src = data;
+	const char *path = calldata_string(cd, "path");
+	if (!path || !*path)
+		return;
+
+	pthread_mutex_lock(&src->replay_mutex);
+	start_replay(src, path, calldata_bool(cd, "realtime"));
+	pthread_mutex_unlock(&src->replay_mutex);
+}
+
+static void cb_stop_frame_replay(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(cd);
+	struct cm_source *src = data;
+
+	pthread_mutex_lock(&src->replay_mutex);
+	stop_replay(src);
+	pthread_mutex_unlock(&src->replay_mutex);
+}
+
+void cm_frame_replay_init(struct cm_source *src)
+{
+	pthread_mutex_init(&src->callback_mutex, NULL);
+	pthread_mutex_init(&src->replay_mutex, NULL);
+
+	if (!src->self)
+		return;
+
+	proc_handler_t *ph = obs_source_get_proc_handler(src->self);
+	proc_handler_add(ph, "void start_frame_recording(in string path)", cb_start_frame_recording, src);
+	proc_handler_add(ph, "void stop_frame_recording()", cb_stop_frame_recording, src);
+	proc_handler_add(ph, "void start_frame_replay(in string path, in bool realtime)", cb_start_frame_replay, src);
+	proc_handler_add(ph, "void stop_frame_replay()", cb_stop_frame_replay, src);
+}
+
+void cm_frame_replay_free(struct cm_source *src)
+{
+	stop_replay(src);
+	stop_recording(src);
+
+	pthread_mutex_destroy(&src->replay_mutex);
+	pthread_mutex_destroy(&src->callback_mutex);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Recording of the frames given to a scope, and replay of a recording into the scope.
+ * The file format is described in frame-record.h.
+ * These are controlled through the proc handler of the scope source;
+ *   void start_frame_recording(in string path)
+ *   void stop_frame_recording()
+ *   void start_frame_replay(in string path, in bool realtime)
+ *   void stop_frame_replay()
+ * While replaying, the frames from the target are not given to the scope.
+ * If `realtime` is false, the frames are replayed as fast as the scope can process.
+ */
+
+void cm_frame_replay_init(struct cm_source *src);
+void cm_frame_replay_free(struct cm_source *src);
+
+// Records the frame if recording, and calls the callback of `src` unless replaying.
+void cm_deliver_surface(struct cm_source *src, struct cm_surface_data *surface_data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,19 +4,16 @@
 #include <graphics/matrix4.h>
 #include "common.h"
 #include "util.h"
+#include "histogram-kernel.h"
+#include "histogram-tiles.h"
+#include "worker-pool.h"
+#include "trace.h"
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "his_render";
 static const char *prof_draw_histogram_name = "draw_histogram";
 static const char *prof_draw_name = "draw";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
 #define HI_SIZE 256
 
@@ -35,6 +32,12 @@ static const char *prof_draw_name = "draw";
 
 #define GRATICULE_H_MAX 64
 
+#define BAND_MIN_PIXELS 65536
+
+// If more tiles than this ratio have changed, the tiles are not used for the next TILES_BACKOFF_FRAMES frames.
+#define TILES_DYNAMIC_RATIO 0.5
+#define TILES_BACKOFF_FRAMES 30
+
 struct his_source
 {
 	struct cm_source cm;
@@ -45,6 +48,12 @@ struct his_source
 	uint8_t *tex_buf[2];
 	uint32_t hi_max[2][3];
 	volatile int w_tex_buf;
+	volatile long tex_seq; // incremented when tex_buf is written
+	long tex_seq_uploaded; // graphics thread
+	uint32_t *band_buf;
+	uint32_t band_buf_n;
+	struct his_tiles tiles; // pipeline thread
+	uint32_t tiles_backoff;
 
 	gs_vertbuffer_t *graticule_line_vbuf;
 
@@ -96,6 +105,8 @@ static void his_destroy(void *data)
 
 	bfree(src->tex_buf[0]);
 	bfree(src->tex_buf[1]);
+	bfree(src->band_buf);
+	his_tiles_free(&src->tiles);
 
 	bfree(src);
 }
@@ -118,7 +129,8 @@ static void his_update(void *data, obs_data_t *settings)
 
 	src->components = (uint32_t)obs_data_get_int(settings, "components");
 	src->cm.flags = (src->components & COMP_RGB ? CM_FLAG_CONVERT_RGB : 0) |
-			(src->components & COMP_YUV ? CM_FLAG_CONVERT_YUV : 0);
+			(src->components & COMP_Y ? CM_FLAG_CONVERT_Y : 0) |
+			(src->components & COMP_UV ? CM_FLAG_CONVERT_UV : 0);
 
 	src->level_height = (int)obs_data_get_int(settings, "level_height");
 
@@ -158,11 +170,14 @@ static void his_update(void *data, obs_data_t *settings)
 	UPDATE_PROP(int, src->graticule_vertical_lines, (int)obs_data_get_int(settings, "graticule_vertical_lines"),
 		    src->graticule_need_update);
 
+	cm_request_refresh(&src->cm);
+
 #undef UPDATE_PROP
 }
 
 static void his_get_defaults(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "target_scale", 2);
 	obs_data_set_default_int(settings, "components", COMP_RGB);
 	obs_data_set_default_int(settings, "level_height", 200);
@@ -327,31 +342,118 @@ static inline void inc_uint16(uint16_t *c)
 		++*c;
 }
 
-static inline void his_calculate_max(struct his_source *src, uint32_t *hi_max, const uint32_t *dbuf)
+struct his_band_ctx
+{
+	const struct cm_surface_data *surface_data;
+	uint32_t components;
+	uint32_t *band_buf;
+};
+
+static void his_draw_band(void *data, uint32_t index, uint32_t n_bands)
+{
+	struct his_band_ctx *ctx = data;
+	const uint32_t height = ctx->surface_data->height;
+
+	uint32_t *dbuf = ctx->band_buf + HI_SIZE * 4 * index;
+	memset(dbuf, 0, sizeof(uint32_t) * HI_SIZE * 4);
+	his_kernel_accumulate(dbuf, ctx->surface_data, ctx->components, height * index / n_bands,
+		       height * (index + 1) / n_bands);
+}
+
+static void ensure_band_buf(struct his_source *src, uint32_t n_bands)
 {
-	const bool calc_b = (src->components & 0x11) ? true : false;
-	const bool calc_g = (src->components & 0x22) ? true : false;
-	const bool calc_r = (src->components & 0x44) ? true : false;
-
-	hi_max[0] = 1;
-	hi_max[1] = 1;
-	hi_max[2] = 1;
-	for (int i = 0; i < HI_SIZE; i++) {
-		if (calc_r && dbuf[i * 4 + 0] > hi_max[0])
-			hi_max[0] = dbuf[i * 4 + 0];
-		if (calc_g && dbuf[i * 4 + 1] > hi_max[1])
-			hi_max[1] = dbuf[i * 4 + 1];
-		if (calc_b && dbuf[i * 4 + 2] > hi_max[2])
-			hi_max[2] = dbuf[i * 4 + 2];
+	if (src->band_buf_n < n_bands) {
+		bfree(src->band_buf);
+		src->band_buf = bmalloc(sizeof(uint32_t) * HI_SIZE * 4 * n_bands);
+		src->band_buf_n = n_bands;
 	}
 }
 
-static inline void his_fix_max_level(uint32_t *hi_max, uint32_t x)
+struct his_tiles_ctx
+{
+	struct his_tiles *tiles;
+	const struct cm_surface_data *surface_data;
+	uint32_t n_rows;
+	uint32_t *band_buf;
+	volatile long n_changed;
+};
+
+static void his_tiles_band(void *data, uint32_t index, uint32_t n_bands)
 {
-	uint32_t v = x == 0 ? 1 : x;
-	hi_max[0] = v;
-	hi_max[1] = v;
-	hi_max[2] = v;
+	struct his_tiles_ctx *ctx = data;
+
+	uint32_t *delta = ctx->band_buf + HI_SIZE * 4 * index;
+	memset(delta, 0, sizeof(uint32_t) * HI_SIZE * 4);
+	uint32_t n = his_tiles_update(ctx->tiles, delta, ctx->surface_data, ctx->n_rows * index / n_bands,
+				      ctx->n_rows * (index + 1) / n_bands);
+	os_atomic_add_long(&ctx->n_changed, (long)n);
+}
+
+/*
+ * Accumulates only the tiles that have changed since the previous frame.
+ * Returns false if the tiles are not used for this frame.
+ */
+static bool his_draw_tiles(struct his_source *src, uint32_t *dbuf, const struct cm_surface_data *surface_data)
+{
+	if (src->tiles_backoff) {
+		src->tiles_backoff--;
+		return false;
+	}
+
+	const uint32_t n_rows = his_tiles_begin(&src->tiles, surface_data, src->components);
+	if (!n_rows)
+		return false;
+
+	const uint32_t row_pixels = surface_data->width * HIS_TILE_SIZE;
+	const uint32_t n_bands = cm_worker_n_bands(n_rows, (BAND_MIN_PIXELS + row_pixels - 1) / row_pixels);
+	ensure_band_buf(src, n_bands);
+
+	struct his_tiles_ctx ctx = {
+		.tiles = &src->tiles,
+		.surface_data = surface_data,
+		.n_rows = n_rows,
+		.band_buf = src->band_buf,
+	};
+	cm_worker_run(his_tiles_band, &ctx, n_bands);
+
+	for (uint32_t j = 0; j < n_bands; j++)
+		his_tiles_commit(&src->tiles, src->band_buf + HI_SIZE * 4 * j);
+	memcpy(dbuf, src->tiles.total, sizeof(uint32_t) * HI_SIZE * 4);
+
+	const long n_changed = os_atomic_load_long(&ctx.n_changed);
+	cm_trace_instant("his_tiles_changed", n_changed);
+
+	// Moving content is accumulated faster without the tiles.
+	if (n_changed > (long)(src->tiles.n_x * n_rows * TILES_DYNAMIC_RATIO))
+		src->tiles_backoff = TILES_BACKOFF_FRAMES;
+
+	return true;
+}
+
+// Accumulates the whole frame, split into bands on the worker threads.
+static void his_draw_full(struct his_source *src, uint32_t *dbuf, const struct cm_surface_data *surface_data)
+{
+	const uint32_t height = surface_data->height;
+	const uint32_t width = surface_data->width;
+
+	const uint32_t n_bands = cm_worker_n_bands(height, (BAND_MIN_PIXELS + width - 1) / width);
+	if (n_bands > 1) {
+		ensure_band_buf(src, n_bands);
+		struct his_band_ctx ctx = {
+			.surface_data = surface_data,
+			.components = src->components,
+			.band_buf = src->band_buf,
+		};
+		cm_worker_run(his_draw_band, &ctx, n_bands);
+
+		for (uint32_t j = 0; j < n_bands; j++) {
+			const uint32_t *partial = src->band_buf + HI_SIZE * 4 * j;
+			for (int i = 0; i < HI_SIZE * 4; i++)
+				dbuf[i] += partial[i];
+		}
+	} else {
+		his_kernel_accumulate(dbuf, surface_data, src->components, 0, height);
+	}
 }
 
 static inline void his_draw_histogram(struct his_source *src, uint8_t *tex_buf, uint32_t *hi_max,
@@ -364,57 +466,17 @@ static inline void his_draw_histogram(struct his_source *src, uint8_t *tex_buf,
 	for (int i = 0; i < HI_SIZE * 4; i++)
 		dbuf[i] = 0;
 
-	const uint8_t *video_data = NULL;
-	if (src->components & COMP_RGB)
-		video_data = surface_data->rgb_data;
-	else if (src->components & COMP_YUV)
-		video_data = surface_data->yuv_data;
-	if (!video_data)
-		return;
-
-	const bool calc_b = (src->components & 0x11) ? true : false;
-	const bool calc_g = (src->components & 0x22) ? true : false;
-	const bool calc_r = (src->components & 0x44) ? true : false;
-
-	for (uint32_t y = 0; y < height; y++) {
-		const uint8_t *v = video_data + surface_data->linesize * y;
-		for (uint32_t x = 0; x < width; x++) {
-			const uint8_t b = *v++;
-			const uint8_t g = *v++;
-			const uint8_t r = *v++;
-			const uint8_t a = *v++;
-			if (!a)
-				continue;
-			if (calc_r)
-				dbuf[r * 4 + 0]++;
-			if (calc_g)
-				dbuf[g * 4 + 1]++;
-			if (calc_b)
-				dbuf[b * 4 + 2]++;
-		}
-	}
+	if (!his_draw_tiles(src, dbuf, surface_data))
+		his_draw_full(src, dbuf, surface_data);
 
 	if (src->level_fixed_value > 0)
-		his_fix_max_level(hi_max, src->level_fixed_value);
+		his_kernel_fix_max(hi_max, src->level_fixed_value);
 	else if (src->level_ratio_value > 0)
-		his_fix_max_level(hi_max, (uint64_t)width * height * src->level_ratio_value / 1000);
+		his_kernel_fix_max(hi_max, (uint32_t)((uint64_t)width * height * src->level_ratio_value / 1000));
 	else
-		his_calculate_max(src, hi_max, dbuf);
+		his_kernel_calculate_max(hi_max, dbuf, src->components);
 
-	float *flt = (float *)tex_buf;
-	if (src->logscale) {
-		for (int j = 0, mask = 0x44; j < 3; j++, mask >>= 1) {
-			if (!(src->components & mask))
-				continue;
-			const float s = 1.0f / logf((float)(hi_max[j] + 1));
-			for (int i = 0; i < HI_SIZE; i++)
-				flt[i * 4 + j] = dbuf[i * 4 + j] ? logf((float)(dbuf[i * 4 + j] + 1)) * s : 0;
-			hi_max[j] = 1;
-		}
-	} else {
-		for (int i = 0; i < HI_SIZE * 4; i++)
-			flt[i] = (float)dbuf[i];
-	}
+	his_kernel_to_float((float *)tex_buf, dbuf, hi_max, src->components, src->logscale);
 }
 
 static void his_set_image(struct his_source *src, const uint8_t *tex_buf, uint32_t *hi_max)
@@ -435,7 +497,9 @@ static void his_surface_cb(void *data, struct cm_surface_data *surface_data)
 
 	if ((src->components & COMP_RGB) && !surface_data->rgb_data)
 		return;
-	if ((src->components & COMP_YUV) && !surface_data->yuv_data)
+	if ((src->components & COMP_Y) && !surface_data->y_data)
+		return;
+	if ((src->components & COMP_UV) && !surface_data->u_data)
 		return;
 	if (!surface_data->width)
 		return;
@@ -447,6 +511,7 @@ static void his_surface_cb(void *data, struct cm_surface_data *surface_data)
 	his_draw_histogram(src, src->tex_buf[src->w_tex_buf], src->hi_max[src->w_tex_buf], surface_data);
 	PROFILE_END(prof_draw_histogram_name);
 	src->w_tex_buf ^= 1;
+	os_atomic_inc_long(&src->tex_seq);
 }
 
 static void create_graticule_vbuf(struct his_source *src)
@@ -560,9 +625,14 @@ static void his_render(void *data, gs_effect_t *effect)
 	cm_render_target(&src->cm);
 
 	PROFILE_START(prof_draw_name);
+	const long seq = os_atomic_load_long(&src->tex_seq);
 	int r_tex_buf = src->w_tex_buf ^ 1;
 	if (src->tex_buf[r_tex_buf]) {
-		his_set_image(src, src->tex_buf[r_tex_buf], src->hi_max[r_tex_buf]);
+		// Static frames are not analyzed again; upload only a new result.
+		if (!src->tex_hi || seq != src->tex_seq_uploaded) {
+			his_set_image(src, src->tex_buf[r_tex_buf], src->hi_max[r_tex_buf]);
+			src->tex_seq_uploaded = seq;
+		}
 		render_histogram(src);
 	}
 	PROFILE_END(prof_draw_name);
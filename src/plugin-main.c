@@ -22,6 +22,11 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include <obs-frontend-api.h>
 
 #include "plugin-macros.generated.h"
+#include "histogram-kernel.h"
+#include "worker-pool.h"
+#include "common.h"
+#include "source-stats.h"
+#include "trace.h"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
@@ -39,6 +44,7 @@ extern const struct obs_source_info colormonitor_falsecolor_filter;
 extern const struct obs_source_info colormonitor_focuspeaking;
 extern const struct obs_source_info colormonitor_focuspeaking_filter;
 extern const struct obs_source_info colormonitor_roi;
+extern const struct obs_source_info colormonitor_scope_tap;
 void scope_docks_init();
 
 static bool register_source_with_flags(const struct obs_source_info *const_info, uint32_t flags)
@@ -71,6 +77,12 @@ bool obs_module_load(void)
 #endif
 	config_set_default_bool(cfg, CONFIG_SECTION_NAME, "ShowSource", true);
 	config_set_default_bool(cfg, CONFIG_SECTION_NAME, "ShowFilter", true);
+	config_set_default_int(cfg, CONFIG_SECTION_NAME, "WorkerThreads", 0);
+	config_set_default_bool(cfg, CONFIG_SECTION_NAME, "ConvertYUVOnCPU", false);
+	config_set_default_bool(cfg, CONFIG_SECTION_NAME, "SkipStaticFrames", true);
+	config_set_default_int(cfg, CONFIG_SECTION_NAME, "HiddenScopeRate", 0);
+	config_set_default_int(cfg, CONFIG_SECTION_NAME, "StatsLogInterval", 600);
+	config_set_default_int(cfg, CONFIG_SECTION_NAME, "TraceEventsPerThread", 65536);
 
 	bool show_source = config_get_bool(cfg, CONFIG_SECTION_NAME, "ShowSource");
 	uint32_t src_flags = show_source ? 0 : OBS_SOURCE_CAP_DISABLED;
@@ -78,6 +90,17 @@ bool obs_module_load(void)
 	bool show_filter = config_get_bool(cfg, CONFIG_SECTION_NAME, "ShowFilter");
 	uint32_t flt_flags = show_filter ? 0 : OBS_SOURCE_CAP_DISABLED;
 
+	his_kernel_init();
+	blog(LOG_INFO, "histogram kernel: %s", his_kernel_name());
+
+	cm_worker_pool_init((int)config_get_int(cfg, CONFIG_SECTION_NAME, "WorkerThreads"));
+	cm_set_cpu_yuv_conversion(config_get_bool(cfg, CONFIG_SECTION_NAME, "ConvertYUVOnCPU"));
+	cm_set_skip_static_frames(config_get_bool(cfg, CONFIG_SECTION_NAME, "SkipStaticFrames"));
+	cm_set_hidden_scope_rate((int)config_get_int(cfg, CONFIG_SECTION_NAME, "HiddenScopeRate"));
+	cm_stats_set_log_interval((int)config_get_int(cfg, CONFIG_SECTION_NAME, "StatsLogInterval"));
+	const int64_t trace_events = config_get_int(cfg, CONFIG_SECTION_NAME, "TraceEventsPerThread");
+	cm_trace_init(trace_events > 0 ? (uint32_t)trace_events : 0);
+
 	if (!register_source_with_flags(&colormonitor_vectorscope_v1, src_flags))
 		return false;
 	if (!register_source_with_flags(&colormonitor_vectorscope, src_flags))
@@ -100,9 +123,17 @@ bool obs_module_load(void)
 		return false;
 	if (!register_source_with_flags(&colormonitor_roi, src_flags))
 		return false;
+	if (!register_source_with_flags(&colormonitor_scope_tap, flt_flags))
+		return false;
 
 	scope_docks_init();
 	blog(LOG_INFO, "plugin loaded (plugin version %s, API version %d.%d.%d)", PLUGIN_VERSION, LIBOBS_API_MAJOR_VER,
 	     LIBOBS_API_MINOR_VER, LIBOBS_API_PATCH_VER);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	cm_worker_pool_free();
+	cm_trace_free();
+}
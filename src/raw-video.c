@@ -0,0 +1,152 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "common.h"
+#include "raw-video.h"
+
+struct cm_raw_video
+{
+	struct cm_source *src;
+	struct video_scale_info conversion;
+	int colorspace;
+};
+
+static enum video_format select_format(enum video_format output_format)
+{
+	switch (output_format) {
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I444:
+		// Same as the encoders so that OBS Studio does not convert the format.
+		return output_format;
+	default:
+		return VIDEO_FORMAT_NV12;
+	}
+}
+
+static void copy_plane(uint8_t *dst, const uint8_t *data, uint32_t linesize, uint32_t width_bytes, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(dst + (size_t)width_bytes * y, data + (size_t)linesize * y, width_bytes);
+}
+
+/*
+ * Called by the video output thread.
+ * While the raw video is connected, this thread writes the queue instead of the graphics thread.
+ */
+static void raw_video_cb(void *param, struct video_data *frame)
+{
+	struct cm_raw_video *rv = param;
+	struct cm_source *src = rv->src;
+	const struct video_scale_info *conv = &rv->conversion;
+
+	if (!cm_is_analysis_frame(src, frame->timestamp))
+		return;
+
+	const uint32_t width = conv->width;
+	const uint32_t height = conv->height;
+	const uint32_t shift = conv->format == VIDEO_FORMAT_I444 ? 0 : 1;
+	const uint32_t uv_width = width >> shift;
+	const uint32_t uv_height = height >> shift;
+	const size_t y_size = (size_t)width * height;
+	const size_t uv_size = (size_t)uv_width * uv_height;
+
+	struct cm_surface_queue_item *item = &src->queue[src->i_write_queue];
+	if (item->raw_size != y_size + uv_size * 2) {
+		bfree(item->raw_data);
+		item->raw_data = bmalloc(y_size + uv_size * 2);
+		item->raw_size = y_size + uv_size * 2;
+	}
+
+	// The planes are packed so that the size is a multiple of the width.
+	struct cm_surface_data *sd = &item->raw_sd;
+	memset(sd, 0, sizeof(*sd));
+	sd->width = width;
+	sd->height = height;
+	sd->colorspace = rv->colorspace;
+	sd->timestamp = frame->timestamp;
+	sd->y_data = item->raw_data;
+	sd->y_linesize = width;
+	sd->uv_shift_x = shift;
+	sd->uv_shift_y = shift;
+	copy_plane(sd->y_data, frame->data[0], frame->linesize[0], width, height);
+
+	uint8_t *uv = item->raw_data + y_size;
+	if (conv->format == VIDEO_FORMAT_NV12) {
+		copy_plane(uv, frame->data[1], frame->linesize[1], uv_width * 2, uv_height);
+		sd->u_data = uv;
+		sd->v_data = uv + 1;
+		sd->uv_linesize = uv_width * 2;
+		sd->uv_step = 2;
+	} else {
+		copy_plane(uv, frame->data[1], frame->linesize[1], uv_width, uv_height);
+		copy_plane(uv + uv_size, frame->data[2], frame->linesize[2], uv_width, uv_height);
+		sd->u_data = uv;
+		sd->v_data = uv + uv_size;
+		sd->uv_linesize = uv_width;
+		sd->uv_step = 1;
+	}
+
+	item->flags = CM_FLAG_RAW_VIDEO;
+	item->cpu_convert = 0;
+	item->width = width;
+	item->height = height;
+	item->colorspace = rv->colorspace;
+	item->timestamp = frame->timestamp;
+	item->cb = src->callback;
+	item->cb_data = src->callback_data;
+
+	cm_queue_ready(src);
+}
+
+static bool same_conversion(const struct video_scale_info *a, const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width && a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+void cm_raw_video_update(struct cm_source *src, uint32_t width, uint32_t height)
+{
+	struct obs_video_info ovi;
+	if (!obs_get_video_info(&ovi))
+		return;
+
+	// The chroma of NV12 and I420 needs even size.
+	const struct video_scale_info conversion = {
+		.format = select_format(ovi.output_format),
+		.width = width & ~1u,
+		.height = height & ~1u,
+		.range = ovi.range,
+		.colorspace = ovi.colorspace,
+	};
+	if (conversion.width < 2 || conversion.height < 2)
+		return;
+
+	if (src->raw_video && same_conversion(&src->raw_video->conversion, &conversion))
+		return;
+
+	cm_raw_video_release(src);
+
+	struct cm_raw_video *rv = bzalloc(sizeof(struct cm_raw_video));
+	rv->src = src;
+	rv->conversion = conversion;
+	rv->colorspace = ovi.colorspace == VIDEO_CS_601 ? 1 : 2;
+	src->raw_video = rv;
+
+	obs_add_raw_video_callback(&rv->conversion, raw_video_cb, rv);
+
+	blog(LOG_INFO, "'%s': connected to the raw video %ux%u %s",
+	     src->self ? obs_source_get_name(src->self) : "(shared)", conversion.width, conversion.height,
+	     get_video_format_name(conversion.format));
+}
+
+void cm_raw_video_release(struct cm_source *src)
+{
+	struct cm_raw_video *rv = src->raw_video;
+	if (!rv)
+		return;
+
+	obs_remove_raw_video_callback(raw_video_cb, rv);
+	src->raw_video = NULL;
+	bfree(rv);
+}
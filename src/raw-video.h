@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frames of Program taken from the raw video output of OBS Studio, ie. the frames given to the encoders.
+ * The frames are NV12, I420, or I444 as the output format, or NV12 if the output has another format.
+ * The Y, U, and V planes are copied into the queue item and given to the scopes without rendering and
+ * reading back from the GPU.
+ * If the size or the format differs from the output settings, OBS Studio converts the frames.
+ */
+
+// Connects to the raw video output, or reconnects if the size has changed. Called by the graphics thread.
+void cm_raw_video_update(struct cm_source *src, uint32_t width, uint32_t height);
+
+// Disconnects from the raw video output. The callback is not called after this returns.
+void cm_raw_video_release(struct cm_source *src);
+
+#ifdef __cplusplus
+}
+#endif
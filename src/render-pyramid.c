@@ -0,0 +1,222 @@
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include "plugin-macros.generated.h"
+#include "render-pyramid.h"
+#include "util.h"
+#include "trace.h"
+
+static const char *prof_render_pyramid_name = "render_pyramid";
+
+struct cm_pyramid
+{
+	obs_weak_source_t *weak_target; // NULL for Program
+	long refs; // protected by pyramids_mutex
+
+	gs_effect_t *effect;
+	gs_texrender_t *levels[CM_PYRAMID_MAX_LEVELS];
+	uint32_t widths[CM_PYRAMID_MAX_LEVELS];
+	uint32_t heights[CM_PYRAMID_MAX_LEVELS];
+	uint64_t frame_time; // video frame time when the level 0 was rendered
+	uint32_t n_levels; // number of the levels made for `frame_time`
+};
+
+static pthread_mutex_t pyramids_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct cm_pyramid *) pyramids;
+
+bool cm_pyramid_match(const struct cm_pyramid *p, obs_source_t *target)
+{
+	if (!target)
+		return !p->weak_target;
+	return p->weak_target && obs_weak_source_references_source(p->weak_target, target);
+}
+
+static struct cm_pyramid *pyramid_create(obs_source_t *target)
+{
+	struct cm_pyramid *p = bzalloc(sizeof(struct cm_pyramid));
+	p->weak_target = target ? obs_source_get_weak_source(target) : NULL;
+	p->effect = create_effect_from_module_file("common.effect");
+
+	blog(LOG_DEBUG, "created pyramid %p for '%s'", p, target ? obs_source_get_name(target) : "(program)");
+	return p;
+}
+
+static void pyramid_destroy(struct cm_pyramid *p)
+{
+	blog(LOG_DEBUG, "destroying pyramid %p", p);
+
+	obs_enter_graphics();
+	for (int i = 0; i < CM_PYRAMID_MAX_LEVELS; i++)
+		gs_texrender_destroy(p->levels[i]);
+	gs_effect_destroy(p->effect);
+	obs_leave_graphics();
+
+	obs_weak_source_release(p->weak_target);
+	bfree(p);
+}
+
+struct cm_pyramid *cm_pyramid_get(obs_source_t *target)
+{
+	struct cm_pyramid *p = NULL;
+
+	pthread_mutex_lock(&pyramids_mutex);
+	for (size_t i = 0; i < pyramids.num; i++) {
+		if (cm_pyramid_match(pyramids.array[i], target)) {
+			p = pyramids.array[i];
+			break;
+		}
+	}
+	if (!p) {
+		p = pyramid_create(target);
+		da_push_back(pyramids, &p);
+	}
+	p->refs++;
+	pthread_mutex_unlock(&pyramids_mutex);
+
+	return p;
+}
+
+void cm_pyramid_release(struct cm_pyramid *p)
+{
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&pyramids_mutex);
+	bool last = --p->refs == 0;
+	if (last) {
+		da_erase_item(pyramids, &p);
+		if (!pyramids.num)
+			da_free(pyramids);
+	}
+	pthread_mutex_unlock(&pyramids_mutex);
+
+	if (last)
+		pyramid_destroy(p);
+}
+
+uint32_t cm_pyramid_level_for_scale(double scale)
+{
+	uint32_t level = 0;
+	while (level + 1 < CM_PYRAMID_MAX_LEVELS && (double)(1u << (level + 1)) <= scale)
+		level++;
+	return level;
+}
+
+static gs_texrender_t *get_texrender(struct cm_pyramid *p, uint32_t level)
+{
+	if (!p->levels[level])
+		p->levels[level] = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	gs_texrender_reset(p->levels[level]);
+	return p->levels[level];
+}
+
+static bool render_level0(struct cm_pyramid *p)
+{
+	obs_source_t *target = NULL;
+	uint32_t width, height;
+	if (p->weak_target) {
+		target = obs_weak_source_get_source(p->weak_target);
+		if (!target)
+			return false;
+		width = obs_source_get_width(target);
+		height = obs_source_get_height(target);
+	} else {
+		struct obs_video_info ovi;
+		obs_get_video_info(&ovi);
+		width = ovi.base_width;
+		height = ovi.base_height;
+	}
+
+	gs_texrender_t *texrender = get_texrender(p, 0);
+	bool ret = false;
+	if (width && height && gs_texrender_begin(texrender, width, height)) {
+		struct vec4 background;
+		vec4_zero(&background);
+		gs_clear(GS_CLEAR_COLOR, &background, 0.0f, 0);
+
+		gs_projection_push();
+		gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+
+		gs_blend_state_push();
+		if (target) {
+			gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+			obs_source_video_render(target);
+		} else {
+			obs_render_main_texture();
+		}
+		gs_blend_state_pop();
+		gs_projection_pop();
+
+		gs_texrender_end(texrender);
+		p->widths[0] = width;
+		p->heights[0] = height;
+		ret = true;
+	}
+
+	obs_source_release(target);
+	return ret;
+}
+
+static bool downsample(struct cm_pyramid *p, uint32_t level)
+{
+	const uint32_t width = p->widths[level - 1];
+	const uint32_t height = p->heights[level - 1];
+	if (!p->effect || (width <= 1 && height <= 1))
+		return false;
+
+	gs_texture_t *tex = gs_texrender_get_texture(p->levels[level - 1]);
+	if (!tex)
+		return false;
+
+	const uint32_t out_width = (width + 1) / 2;
+	const uint32_t out_height = (height + 1) / 2;
+	gs_texrender_t *texrender = get_texrender(p, level);
+	if (!gs_texrender_begin(texrender, out_width, out_height))
+		return false;
+
+	gs_projection_push();
+	gs_ortho(0.0f, (float)out_width, 0.0f, (float)out_height, -100.0f, 100.0f);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	struct vec2 texel_step = {.x = 1.0f / width, .y = 1.0f / height};
+	gs_effect_set_vec2(gs_effect_get_param_by_name(p->effect, "texel_step"), &texel_step);
+	gs_effect_set_texture(gs_effect_get_param_by_name(p->effect, "image"), tex);
+	while (gs_effect_loop(p->effect, "Downsample")) {
+		gs_draw_sprite(tex, 0, out_width, out_height);
+	}
+
+	gs_blend_state_pop();
+	gs_projection_pop();
+	gs_texrender_end(texrender);
+
+	p->widths[level] = out_width;
+	p->heights[level] = out_height;
+	return true;
+}
+
+gs_texture_t *cm_pyramid_get_level(struct cm_pyramid *p, uint32_t level, uint32_t *width, uint32_t *height)
+{
+	if (level >= CM_PYRAMID_MAX_LEVELS)
+		level = CM_PYRAMID_MAX_LEVELS - 1;
+
+	const uint64_t frame_time = obs_get_video_frame_time();
+	if (!p->n_levels || p->frame_time != frame_time) {
+		PROFILE_START(prof_render_pyramid_name);
+		p->n_levels = render_level0(p) ? 1 : 0;
+		p->frame_time = frame_time;
+		PROFILE_END(prof_render_pyramid_name);
+		if (!p->n_levels)
+			return NULL;
+	}
+
+	// Only the levels requested in this frame are made.
+	while (p->n_levels <= level && downsample(p, p->n_levels))
+		p->n_levels++;
+	if (level >= p->n_levels)
+		level = p->n_levels - 1;
+
+	*width = p->widths[level];
+	*height = p->heights[level];
+	return gs_texrender_get_texture(p->levels[level]);
+}
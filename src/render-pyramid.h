@@ -0,0 +1,36 @@
+#pragma once
+
+#include <obs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process-wide cache of the renders of the targets.
+ * A target is rendered once per frame at its full resolution, and each level of the pyramid averages 2x2
+ * texels of the level above. The sources on the same target share the render even if their scales differ;
+ * each source samples the smallest level that is not smaller than its scaled size.
+ * All functions except cm_pyramid_release are called by the graphics thread.
+ */
+#define CM_PYRAMID_MAX_LEVELS 8
+
+struct cm_pyramid;
+
+// Returns the pyramid of `target`, or of Program if `target` is NULL, with a new reference.
+struct cm_pyramid *cm_pyramid_get(obs_source_t *target);
+void cm_pyramid_release(struct cm_pyramid *p);
+bool cm_pyramid_match(const struct cm_pyramid *p, obs_source_t *target);
+
+// Returns the level for the scale, ie. the largest `level` such that `1 << level` does not exceed `scale`.
+uint32_t cm_pyramid_level_for_scale(double scale);
+
+/*
+ * Returns the texture of `level`, whose size is the size of the target halved `level` times with rounding up.
+ * The target is rendered and the levels are made at the first call in each frame.
+ */
+gs_texture_t *cm_pyramid_get_level(struct cm_pyramid *p, uint32_t level, uint32_t *width, uint32_t *height);
+
+#ifdef __cplusplus
+}
+#endif
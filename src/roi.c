@@ -6,16 +6,11 @@
 #include "obs-convenience.h"
 #include "roi.h"
 #include "common.h"
+#include "frame-replay.h"
 #include "util.h"
+#include "trace.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "roi_render";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
 #define INTERACT_DRAW_ROI_RECT 1
 #define INTERACT_DRAG_FIRST 2
@@ -95,6 +90,7 @@ static void roi_update(void *data, obs_data_t *settings)
 
 static void roi_get_defaults(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "target_scale", 2);
 	obs_data_set_default_int(settings, "interleave", 1);
 }
@@ -317,6 +313,8 @@ void roi_register_source(struct roi_source *src, struct cm_source *cm)
 	pthread_mutex_lock(&src->sources_mutex);
 	da_push_back(src->sources, &cm);
 	pthread_mutex_unlock(&src->sources_mutex);
+
+	os_atomic_set_bool(&src->cm.refresh_requested, true);
 }
 
 void roi_unregister_source(struct roi_source *src, struct cm_source *cm)
@@ -333,9 +331,7 @@ static void roi_surface_cb(void *data, struct cm_surface_data *surface_data)
 	pthread_mutex_lock(&src->sources_mutex);
 	for (size_t i = 0; i < src->sources.num; i++) {
 		struct cm_source *cm = src->sources.array[i];
-		if (cm->callback) {
-			cm->callback(cm->callback_data, surface_data);
-		}
+		cm_deliver_surface(cm, surface_data);
 	}
 	pthread_mutex_unlock(&src->sources_mutex);
 }
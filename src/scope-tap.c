@@ -0,0 +1,383 @@
+#include <obs-module.h>
+#include <math.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "common.h"
+#include "scope-tap.h"
+#include "frame-replay.h"
+#include "source-stats.h"
+#include "util.h"
+
+#define SCOPE_TAP_ID ID_PREFIX "scope_tap"
+
+static void tap_surface_cb(void *data, struct cm_surface_data *surface_data);
+
+static const char *tap_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("ScopeTap");
+}
+
+static void *tap_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct scope_tap *tap = bzalloc(sizeof(struct scope_tap));
+
+	pthread_mutex_init(&tap->sources_mutex, NULL);
+
+	cm_create(&tap->cm, settings, source);
+	cm_request(&tap->cm, tap_surface_cb, tap);
+
+	return tap;
+}
+
+static void tap_destroy(void *data)
+{
+	struct scope_tap *tap = data;
+
+	cm_destroy(&tap->cm);
+	da_free(tap->sources);
+	pthread_mutex_destroy(&tap->sources_mutex);
+
+	bfree(tap);
+}
+
+static void copy_plane(uint8_t *dst, const uint8_t *data, uint32_t linesize, uint32_t width_bytes, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(dst + (size_t)width_bytes * y, data + (size_t)linesize * y, width_bytes);
+}
+
+static uint8_t *prepare_raw_data(struct cm_surface_queue_item *item, uint32_t width, size_t size)
+{
+	// The fingerprint of the static frames reads `raw_data` as rows of the width.
+	size = (size + width - 1) / width * width;
+	if (item->raw_size != size) {
+		bfree(item->raw_data);
+		item->raw_data = bzalloc(size);
+		item->raw_size = size;
+	}
+	return item->raw_data;
+}
+
+static void copy_planar(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+			const struct obs_source_frame *frame, uint32_t sx, uint32_t sy)
+{
+	const uint32_t width = frame->width, height = frame->height;
+	const uint32_t uv_width = (width + (1u << sx) - 1) >> sx;
+	const uint32_t uv_height = (height + (1u << sy) - 1) >> sy;
+	const size_t y_size = (size_t)width * height;
+	const size_t uv_size = (size_t)uv_width * uv_height;
+	uint8_t *data = prepare_raw_data(item, width, y_size + uv_size * 2);
+
+	copy_plane(data, frame->data[0], frame->linesize[0], width, height);
+	copy_plane(data + y_size, frame->data[1], frame->linesize[1], uv_width, uv_height);
+	copy_plane(data + y_size + uv_size, frame->data[2], frame->linesize[2], uv_width, uv_height);
+
+	sd->y_data = data;
+	sd->y_linesize = width;
+	sd->u_data = data + y_size;
+	sd->v_data = data + y_size + uv_size;
+	sd->uv_linesize = uv_width;
+	sd->uv_step = 1;
+	sd->uv_shift_x = sx;
+	sd->uv_shift_y = sy;
+}
+
+static void copy_nv12(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+		      const struct obs_source_frame *frame)
+{
+	const uint32_t width = frame->width, height = frame->height;
+	const uint32_t uv_width = (width + 1) / 2, uv_height = (height + 1) / 2;
+	const size_t y_size = (size_t)width * height;
+	uint8_t *data = prepare_raw_data(item, width, y_size + (size_t)uv_width * 2 * uv_height);
+
+	copy_plane(data, frame->data[0], frame->linesize[0], width, height);
+	copy_plane(data + y_size, frame->data[1], frame->linesize[1], uv_width * 2, uv_height);
+
+	sd->y_data = data;
+	sd->y_linesize = width;
+	sd->u_data = data + y_size;
+	sd->v_data = data + y_size + 1;
+	sd->uv_linesize = uv_width * 2;
+	sd->uv_step = 2;
+	sd->uv_shift_x = 1;
+	sd->uv_shift_y = 1;
+}
+
+// Separates the packed 4:2:2 formats into the Y plane and the interleaved UV plane.
+static void copy_packed(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+			const struct obs_source_frame *frame, uint32_t y_offset, uint32_t u_offset, uint32_t v_offset)
+{
+	const uint32_t width = frame->width, height = frame->height;
+	const uint32_t uv_width = (width + 1) / 2;
+	const size_t y_size = (size_t)width * height;
+	uint8_t *data = prepare_raw_data(item, width, y_size + (size_t)uv_width * 2 * height);
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *s = frame->data[0] + (size_t)frame->linesize[0] * y;
+		uint8_t *dy = data + (size_t)width * y;
+		uint8_t *duv = data + y_size + (size_t)uv_width * 2 * y;
+		for (uint32_t x = 0; x < width; x++)
+			dy[x] = s[(x >> 1) * 4 + y_offset + (x & 1) * 2];
+		for (uint32_t x = 0; x < uv_width; x++) {
+			duv[x * 2] = s[x * 4 + u_offset];
+			duv[x * 2 + 1] = s[x * 4 + v_offset];
+		}
+	}
+
+	sd->y_data = data;
+	sd->y_linesize = width;
+	sd->u_data = data + y_size;
+	sd->v_data = data + y_size + 1;
+	sd->uv_linesize = uv_width * 2;
+	sd->uv_step = 2;
+	sd->uv_shift_x = 1;
+	sd->uv_shift_y = 0;
+}
+
+static void copy_luma(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+		      const struct obs_source_frame *frame)
+{
+	uint8_t *data = prepare_raw_data(item, frame->width, (size_t)frame->width * frame->height);
+	copy_plane(data, frame->data[0], frame->linesize[0], frame->width, frame->height);
+
+	sd->y_data = data;
+	sd->y_linesize = frame->width;
+}
+
+// Copies the frame as BGRA, which is the order of the stage surface.
+static void copy_rgb(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+		     const struct obs_source_frame *frame)
+{
+	const uint32_t width = frame->width, height = frame->height;
+	uint8_t *data = prepare_raw_data(item, width, (size_t)width * 4 * height);
+
+	copy_plane(data, frame->data[0], frame->linesize[0], width * 4, height);
+	if (frame->format != VIDEO_FORMAT_BGRA) {
+		const size_t n = (size_t)width * height;
+		for (size_t i = 0; i < n; i++) {
+			uint8_t *p = data + i * 4;
+			if (frame->format == VIDEO_FORMAT_RGBA) {
+				const uint8_t r = p[0];
+				p[0] = p[2];
+				p[2] = r;
+			} else {
+				// The alpha of BGRX is undefined but a transparent pixel is not analyzed.
+				p[3] = 255;
+			}
+		}
+	}
+
+	sd->rgb_data = data;
+	sd->linesize = width * 4;
+}
+
+static bool is_rgb_format(enum video_format format)
+{
+	return format == VIDEO_FORMAT_BGRA || format == VIDEO_FORMAT_BGRX || format == VIDEO_FORMAT_RGBA;
+}
+
+static bool copy_frame(struct cm_surface_data *sd, struct cm_surface_queue_item *item,
+		       const struct obs_source_frame *frame)
+{
+	switch (frame->format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I40A:
+		copy_planar(sd, item, frame, 1, 1);
+		return true;
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I42A:
+		copy_planar(sd, item, frame, 1, 0);
+		return true;
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_YUVA:
+		copy_planar(sd, item, frame, 0, 0);
+		return true;
+	case VIDEO_FORMAT_NV12:
+		copy_nv12(sd, item, frame);
+		return true;
+	case VIDEO_FORMAT_YUY2:
+		copy_packed(sd, item, frame, 0, 1, 3);
+		return true;
+	case VIDEO_FORMAT_YVYU:
+		copy_packed(sd, item, frame, 0, 3, 1);
+		return true;
+	case VIDEO_FORMAT_UYVY:
+		copy_packed(sd, item, frame, 1, 0, 2);
+		return true;
+	case VIDEO_FORMAT_Y800:
+		copy_luma(sd, item, frame);
+		return true;
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_RGBA:
+		copy_rgb(sd, item, frame);
+		return true;
+	default:
+		// High bit depth formats are not supported.
+		return false;
+	}
+}
+
+// The frame has a conversion matrix instead of the color space. Takes the closer one of BT.601 and BT.709.
+static int frame_colorspace(const struct obs_source_frame *frame)
+{
+	if (is_rgb_format(frame->format))
+		return calc_colorspace(0);
+
+	const enum video_range_type range = frame->full_range ? VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL;
+	float m601[16], m709[16], range_min[3], range_max[3];
+	if (!video_format_get_parameters(VIDEO_CS_601, range, m601, range_min, range_max) ||
+	    !video_format_get_parameters(VIDEO_CS_709, range, m709, range_min, range_max))
+		return calc_colorspace(0);
+
+	// The coefficient of V for R
+	const float v = frame->color_matrix[2];
+	return fabsf(v - m601[2]) < fabsf(v - m709[2]) ? 1 : 2;
+}
+
+/*
+ * Called by the thread outputting the frames of the parent source.
+ * This thread is the only writer of the queue of the tap.
+ */
+static struct obs_source_frame *tap_filter_video(void *data, struct obs_source_frame *frame)
+{
+	struct scope_tap *tap = data;
+	struct cm_source *src = &tap->cm;
+
+	if (!frame || !frame->width || !frame->height)
+		return frame;
+
+	os_atomic_set_bool(&tap->rgb_frames, is_rgb_format(frame->format));
+
+	const uint32_t flags = (uint32_t)os_atomic_load_long(&tap->consumer_flags);
+	if (!flags)
+		return frame;
+
+	struct cm_surface_queue_item *item = &src->queue[src->i_write_queue];
+	struct cm_surface_data *sd = &item->raw_sd;
+	memset(sd, 0, sizeof(*sd));
+	if (!copy_frame(sd, item, frame))
+		return frame;
+
+	sd->width = frame->width;
+	sd->height = frame->height;
+	sd->colorspace = frame_colorspace(frame);
+	sd->timestamp = frame->timestamp;
+
+	item->flags = CM_FLAG_RAW_VIDEO;
+	// YUV of an RGB frame is derived by the pipeline thread.
+	item->cpu_convert = sd->rgb_data ? flags & CM_FLAG_CONVERT_YUV : 0;
+	item->width = frame->width;
+	item->height = frame->height;
+	item->colorspace = sd->colorspace;
+	item->timestamp = frame->timestamp;
+	item->cb = src->callback;
+	item->cb_data = src->callback_data;
+
+	cm_queue_ready(src);
+	return frame;
+}
+
+static void tap_tick(void *data, float unused)
+{
+	UNUSED_PARAMETER(unused);
+	struct scope_tap *tap = data;
+
+	uint32_t flags = 0;
+	pthread_mutex_lock(&tap->sources_mutex);
+	for (size_t i = 0; i < tap->sources.num; i++) {
+		struct cm_source *cm = tap->sources.array[i];
+		flags |= cm->flags & (CM_FLAG_CONVERT_RGB | CM_FLAG_CONVERT_YUV);
+	}
+	const size_t n_sources = tap->sources.num;
+	pthread_mutex_unlock(&tap->sources_mutex);
+
+	// The frames are copied only while a scope is registered.
+	os_atomic_set_long(&tap->consumer_flags, (long)flags);
+	if (n_sources)
+		cm_start_pipeline_thread(&tap->cm);
+	else
+		cm_stop_pipeline_thread(&tap->cm);
+
+	cm_stats_tick(&tap->cm);
+}
+
+static void tap_surface_cb(void *data, struct cm_surface_data *surface_data)
+{
+	struct scope_tap *tap = data;
+
+	pthread_mutex_lock(&tap->sources_mutex);
+	for (size_t i = 0; i < tap->sources.num; i++) {
+		struct cm_source *cm = tap->sources.array[i];
+		if (cm_is_analysis_frame(cm, surface_data->timestamp))
+			cm_deliver_surface(cm, surface_data);
+	}
+	pthread_mutex_unlock(&tap->sources_mutex);
+}
+
+void scope_tap_register_source(struct scope_tap *tap, struct cm_source *cm)
+{
+	pthread_mutex_lock(&tap->sources_mutex);
+	da_push_back(tap->sources, &cm);
+	pthread_mutex_unlock(&tap->sources_mutex);
+
+	os_atomic_set_bool(&tap->cm.refresh_requested, true);
+}
+
+void scope_tap_unregister_source(struct scope_tap *tap, struct cm_source *cm)
+{
+	pthread_mutex_lock(&tap->sources_mutex);
+	da_erase_item(tap->sources, &cm);
+	pthread_mutex_unlock(&tap->sources_mutex);
+}
+
+bool scope_tap_can_serve(const struct scope_tap *tap, uint32_t flags)
+{
+	// RGB is not derived from YUV frames.
+	return !(flags & CM_FLAG_CONVERT_RGB) || os_atomic_load_bool(&tap->rgb_frames);
+}
+
+struct find_ctx
+{
+	obs_source_t *filter;
+};
+
+static void find_cb(obs_source_t *parent, obs_source_t *child, void *param)
+{
+	UNUSED_PARAMETER(parent);
+	struct find_ctx *ctx = param;
+
+	if (ctx->filter || !obs_source_enabled(child))
+		return;
+	if (strcmp(obs_source_get_unversioned_id(child), SCOPE_TAP_ID) != 0)
+		return;
+
+	ctx->filter = obs_source_get_ref(child);
+}
+
+obs_source_t *scope_tap_find(obs_source_t *parent, struct scope_tap **tap)
+{
+	*tap = NULL;
+	if (!parent || !(obs_source_get_output_flags(parent) & OBS_SOURCE_ASYNC))
+		return NULL;
+
+	struct find_ctx ctx = {0};
+	obs_source_enum_filters(parent, find_cb, &ctx);
+	if (!ctx.filter)
+		return NULL;
+
+	*tap = obs_obj_get_data(ctx.filter);
+	return ctx.filter;
+}
+
+const struct obs_source_info colormonitor_scope_tap = {
+	.id = SCOPE_TAP_ID,
+	.type = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name = tap_get_name,
+	.create = tap_create,
+	.destroy = tap_destroy,
+	.filter_video = tap_filter_video,
+	.video_tick = tap_tick,
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <util/darray.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Scope tap, a filter on an asynchronous source such as a video capture device or a media source.
+ * The frames of such a source are already in the system memory. The filter copies the planes into the
+ * queue and the scopes whose source is the parent of the filter analyze them without rendering the
+ * source and reading it back from the GPU.
+ */
+struct scope_tap
+{
+	struct cm_source cm;
+	volatile bool rgb_frames; // the last frame was RGB, written by the thread calling filter_video
+	volatile long consumer_flags; // CM_FLAG_CONVERT_* requested by the registered sources, 0 if none
+
+	pthread_mutex_t sources_mutex;
+	DARRAY(struct cm_source *) sources;
+};
+
+// Returns a new reference of the enabled scope tap on `parent` and sets `tap`, or returns NULL.
+obs_source_t *scope_tap_find(obs_source_t *parent, struct scope_tap **tap);
+
+// Returns true if the frames of the tap have the planes requested by `flags`.
+bool scope_tap_can_serve(const struct scope_tap *tap, uint32_t flags);
+
+void scope_tap_register_source(struct scope_tap *, struct cm_source *);
+void scope_tap_unregister_source(struct scope_tap *, struct cm_source *);
+
+#ifdef __cplusplus
+}
+#endif
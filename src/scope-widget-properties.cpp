@@ -16,6 +16,7 @@ static obs_properties_t *scopewidget_properties(const obs_source_t *source)
 		return NULL;
 	obs_property_set_visible(obs_properties_get(props, "target_name"), false);
 	obs_property_set_visible(obs_properties_get(props, "target_scale"), false);
+	obs_property_set_visible(obs_properties_get(props, "scale_mode"), false);
 	obs_property_set_visible(obs_properties_get(props, "bypass"), false);
 	return props;
 }
@@ -8,6 +8,8 @@
 #include <QMenu>
 #include <QAction>
 #include <QMouseEvent>
+#include <QShowEvent>
+#include <QHideEvent>
 #include "plugin-macros.generated.h"
 #include "scope-widget.hpp"
 #include "scope-widget-properties.hpp"
@@ -231,6 +233,24 @@ void ScopeWidget::closeEvent(QCloseEvent *)
 	DestroyDisplay();
 }
 
+/*
+ * A hidden dock, such as an inactive tab, stops drawing so that the scopes on it are regarded as hidden
+ * and stop analyzing the frames. See cm_tick.
+ */
+void ScopeWidget::showEvent(QShowEvent *event)
+{
+	NorisQTDisplay::showEvent(event);
+	if (obs_display_t *display = GetDisplay())
+		obs_display_set_enabled(display, true);
+}
+
+void ScopeWidget::hideEvent(QHideEvent *event)
+{
+	if (obs_display_t *display = GetDisplay())
+		obs_display_set_enabled(display, false);
+	NorisQTDisplay::hideEvent(event);
+}
+
 void ScopeWidget::RemoveDock()
 {
 	obs_frontend_remove_dock(name.c_str());
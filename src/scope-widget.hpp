@@ -19,6 +19,8 @@ public:
 
 private:
 	void closeEvent(QCloseEvent *event) override;
+	void showEvent(QShowEvent *event) override;
+	void hideEvent(QHideEvent *event) override;
 	void RegisterCallbackToDisplay();
 
 	// for interactions
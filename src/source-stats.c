@@ -0,0 +1,264 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include "plugin-macros.generated.h"
+#include "common.h"
+#include "capture-cache.h"
+#include "roi.h"
+#include "timing-stats.h"
+#include "source-stats.h"
+
+struct stats_counters
+{
+	uint64_t dropped;
+	uint64_t skipped_static;
+	uint64_t window_start;
+};
+
+// Copy of the window given to the formatting.
+struct stats_values
+{
+	struct cm_timing timing[CM_STAT_COUNT];
+	uint64_t dropped;
+	uint64_t skipped_static;
+	uint64_t window_ns;
+};
+
+/*
+ * Each timing, and the counters, is written under its own mutex, which only the writers take; most of them
+ * are written by one thread. The readers copy them under a sequence lock so that get_stats never blocks the
+ * graphics thread.
+ */
+struct stats_slot
+{
+	pthread_mutex_t write_mutex;
+	volatile long seq; // odd while written
+};
+
+#define SLOT_COUNTERS CM_STAT_COUNT
+
+struct cm_source_stats
+{
+	struct cm_timing timing[CM_STAT_COUNT];
+	struct stats_counters counters;
+	struct stats_slot slots[CM_STAT_COUNT + 1];
+};
+
+static const char *stat_names[CM_STAT_COUNT] = {
+	"render", "convert", "stage", "map", "convert_cpu", "callback", "latency",
+};
+
+static uint64_t log_interval_ns = 0;
+
+static void cb_get_stats(void *data, calldata_t *cd);
+
+void cm_stats_set_log_interval(int seconds)
+{
+	log_interval_ns = seconds > 0 ? (uint64_t)seconds * 1000000000ULL : 0;
+}
+
+void cm_stats_init(struct cm_source *src)
+{
+	src->stats = bzalloc(sizeof(struct cm_source_stats));
+	for (int i = 0; i <= CM_STAT_COUNT; i++)
+		pthread_mutex_init(&src->stats->slots[i].write_mutex, NULL);
+	src->stats->counters.window_start = os_gettime_ns();
+
+	if (!src->self)
+		return;
+
+	proc_handler_t *ph = obs_source_get_proc_handler(src->self);
+	proc_handler_add(ph, "void get_stats(out string json)", cb_get_stats, src);
+}
+
+void cm_stats_free(struct cm_source *src)
+{
+	if (!src->stats)
+		return;
+	for (int i = 0; i <= CM_STAT_COUNT; i++)
+		pthread_mutex_destroy(&src->stats->slots[i].write_mutex);
+	bfree(src->stats);
+	src->stats = NULL;
+}
+
+static void write_begin(struct stats_slot *slot)
+{
+	pthread_mutex_lock(&slot->write_mutex);
+	os_atomic_inc_long(&slot->seq);
+}
+
+static void write_end(struct stats_slot *slot)
+{
+	os_atomic_inc_long(&slot->seq);
+	pthread_mutex_unlock(&slot->write_mutex);
+}
+
+// Copies `size` bytes written under `slot`, retrying if a writer modified them meanwhile.
+static void read_slot(struct stats_slot *slot, void *dst, const void *src, size_t size)
+{
+	for (;;) {
+		const long seq = os_atomic_load_long(&slot->seq);
+		if (seq & 1) {
+			os_sleep_ms(0);
+			continue;
+		}
+		memcpy(dst, src, size);
+		// The read-modify-write is a full barrier, so the copy above is complete before the check.
+		if (os_atomic_compare_swap_long(&slot->seq, seq, seq))
+			return;
+	}
+}
+
+void cm_stats_add(struct cm_source *src, enum cm_stat_id id, uint64_t ns)
+{
+	struct cm_source_stats *st = src->stats;
+	write_begin(&st->slots[id]);
+	cm_timing_add(&st->timing[id], ns);
+	write_end(&st->slots[id]);
+}
+
+void cm_stats_add_dropped(struct cm_source *src)
+{
+	struct cm_source_stats *st = src->stats;
+	write_begin(&st->slots[SLOT_COUNTERS]);
+	st->counters.dropped++;
+	write_end(&st->slots[SLOT_COUNTERS]);
+}
+
+void cm_stats_add_static(struct cm_source *src)
+{
+	struct cm_source_stats *st = src->stats;
+	write_begin(&st->slots[SLOT_COUNTERS]);
+	st->counters.skipped_static++;
+	write_end(&st->slots[SLOT_COUNTERS]);
+}
+
+/*
+ * Copies the window so that the formatting does not block the threads adding the samples.
+ * Only cm_stats_tick resets the window; it waits only for the writers, not for the other readers.
+ */
+static void snapshot(struct stats_values *dst, struct cm_source *src, bool reset)
+{
+	struct cm_source_stats *st = src->stats;
+	const uint64_t now = os_gettime_ns();
+
+	for (int i = 0; i < CM_STAT_COUNT; i++) {
+		struct stats_slot *slot = &st->slots[i];
+		if (reset) {
+			write_begin(slot);
+			dst->timing[i] = st->timing[i];
+			cm_timing_reset(&st->timing[i]);
+			write_end(slot);
+		} else {
+			read_slot(slot, &dst->timing[i], &st->timing[i], sizeof(dst->timing[i]));
+		}
+	}
+
+	struct stats_counters counters;
+	if (reset) {
+		write_begin(&st->slots[SLOT_COUNTERS]);
+		counters = st->counters;
+		st->counters.dropped = 0;
+		st->counters.skipped_static = 0;
+		st->counters.window_start = now;
+		write_end(&st->slots[SLOT_COUNTERS]);
+	} else {
+		read_slot(&st->slots[SLOT_COUNTERS], &counters, &st->counters, sizeof(counters));
+	}
+	dst->dropped = counters.dropped;
+	dst->skipped_static = counters.skipped_static;
+	dst->window_ns = now - counters.window_start;
+}
+
+static const char *source_name(const struct cm_source *src)
+{
+	return src->self ? obs_source_get_name(src->self) : "(shared)";
+}
+
+static void stats_to_json(struct dstr *json, struct cm_source *src, const struct stats_values *ss)
+{
+	dstr_catf(json,
+		  "{\"window_s\":%.3f,\"frames_analyzed\":%llu,\"frames_dropped\":%llu,\"frames_static\":%llu,"
+		  "\"dropped_total\":%ld",
+		  ss->window_ns * 1e-9, (unsigned long long)ss->timing[CM_STAT_CALLBACK].count,
+		  (unsigned long long)ss->dropped, (unsigned long long)ss->skipped_static,
+		  os_atomic_load_long(&src->dropped_frames));
+
+	for (int i = 0; i < CM_STAT_COUNT; i++) {
+		const struct cm_timing *t = &ss->timing[i];
+		dstr_catf(json,
+			  ",\"%s\":{\"count\":%llu,\"min_us\":%.1f,\"avg_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+			  stat_names[i], (unsigned long long)t->count, t->min * 1e-3, cm_timing_avg(t) * 1e-3,
+			  cm_timing_percentile(t, 99.0) * 1e-3, t->max * 1e-3);
+	}
+}
+
+// Returns the source that renders and reads back the frames given to `src`, or NULL if `src` itself does.
+static struct cm_source *upstream_source(struct cm_source *src)
+{
+	if (src->roi)
+		return &src->roi->cm;
+	if (src->capture)
+		return &src->capture->cm;
+	return NULL;
+}
+
+static void cb_get_stats(void *data, calldata_t *cd)
+{
+	struct cm_source *src = data;
+	struct stats_values *ss = bmalloc(sizeof(struct stats_values));
+	struct dstr json = {0};
+
+	snapshot(ss, src, false);
+	stats_to_json(&json, src, ss);
+
+	// The capture and the ROI are replaced under this mutex.
+	pthread_mutex_lock(&src->target_update_mutex);
+	struct cm_source *upstream = upstream_source(src);
+	if (upstream) {
+		snapshot(ss, upstream, false);
+		dstr_cat(&json, ",\"capture\":");
+		stats_to_json(&json, upstream, ss);
+		dstr_cat(&json, "}");
+	}
+	pthread_mutex_unlock(&src->target_update_mutex);
+	dstr_cat(&json, "}");
+
+	calldata_set_string(cd, "json", json.array);
+
+	dstr_free(&json);
+	bfree(ss);
+}
+
+static void log_summary(struct cm_source *src, const struct stats_values *ss)
+{
+	struct dstr msg = {0};
+
+	for (int i = 0; i < CM_STAT_COUNT; i++) {
+		const struct cm_timing *t = &ss->timing[i];
+		if (!t->count)
+			continue;
+		dstr_catf(&msg, " %s=%.2f/%.2f/%.2f", stat_names[i], t->min * 1e-6, cm_timing_avg(t) * 1e-6,
+			  cm_timing_percentile(t, 99.0) * 1e-6);
+	}
+
+	blog(LOG_INFO, "'%s': %.0f s, analyzed %llu, dropped %llu, static %llu, min/avg/p99 ms:%s", source_name(src),
+	     ss->window_ns * 1e-9, (unsigned long long)ss->timing[CM_STAT_CALLBACK].count,
+	     (unsigned long long)ss->dropped, (unsigned long long)ss->skipped_static,
+	     msg.array ? msg.array : " (no frame)");
+
+	dstr_free(&msg);
+}
+
+void cm_stats_tick(struct cm_source *src)
+{
+	// Only this function writes window_start.
+	struct cm_source_stats *st = src->stats;
+	if (!log_interval_ns || os_gettime_ns() - st->counters.window_start < log_interval_ns)
+		return;
+
+	struct stats_values *ss = bmalloc(sizeof(struct stats_values));
+	snapshot(ss, src, true);
+	log_summary(src, ss);
+	bfree(ss);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime statistics of each cm_source, always enabled.
+ * The durations are the CPU time of the calls; the time spent by the GPU is seen only when a call waits for it.
+ * The statistics are accumulated over a window, which is reset after the periodic summary is logged.
+ * They are given as JSON by the proc handler of the scope source;
+ *   void get_stats(out string json)
+ * If the scope shares a capture or is given frames by an ROI source, the statistics of that capture are
+ * included as `capture`.
+ */
+
+enum cm_stat_id {
+	CM_STAT_RENDER, // render the target, graphics thread
+	CM_STAT_CONVERT, // draw RGB and the packed YUV planes, graphics thread
+	CM_STAT_STAGE, // gs_stage_texture, graphics thread
+	CM_STAT_MAP, // gs_stagesurface_map, graphics thread
+	CM_STAT_CONVERT_CPU, // RGB to YUV on the CPU, pipeline thread
+	CM_STAT_CALLBACK, // analysis by the scope, pipeline thread
+	CM_STAT_LATENCY, // from the item being ready until the pipeline thread takes it
+	CM_STAT_COUNT,
+};
+
+void cm_stats_init(struct cm_source *src);
+void cm_stats_free(struct cm_source *src);
+
+void cm_stats_add(struct cm_source *src, enum cm_stat_id id, uint64_t ns);
+void cm_stats_add_dropped(struct cm_source *src);
+void cm_stats_add_static(struct cm_source *src);
+
+// Logs the summary if the interval has elapsed. Called by cm_tick.
+void cm_stats_tick(struct cm_source *src);
+
+// Sets the interval of the summary in the log. 0 disables the summary.
+void cm_stats_set_log_interval(int seconds);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,219 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/darray.h>
+#include "plugin-macros.generated.h"
+#include "trace-buffer.h"
+#include "trace.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#define MAX_THREADS 64 // threads recording at the same time
+
+volatile bool cm_trace_enabled = false;
+
+struct thread_ring
+{
+	struct cm_trace_ring ring;
+	bool owned; // protected by mutex, cleared when the owning thread exits
+	volatile bool busy; // set by the owning thread while checking `cm_trace_enabled` and pushing
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct thread_ring *) rings; // protected by mutex, freed at unload
+static uint32_t events_per_thread = 0;
+static uint64_t ts_origin = 0;
+static volatile long generation = 0; // incremented at each start to clear the rings
+
+static THREAD_LOCAL struct thread_ring *thread_ring = NULL;
+static THREAD_LOCAL long thread_generation = 0;
+static THREAD_LOCAL bool thread_overflow = false;
+static THREAD_LOCAL char thread_name[CM_TRACE_THREAD_NAME_SIZE];
+
+void cm_trace_set_thread_name(const char *name)
+{
+	snprintf(thread_name, sizeof(thread_name), "%s", name);
+}
+
+// Takes over the ring of an exited thread if any, so that the restarted threads do not add rings.
+static struct thread_ring *create_thread_ring(void)
+{
+	struct thread_ring *tr = NULL;
+	const char *name = thread_name[0] ? thread_name : gs_get_context() ? "graphics" : "thread";
+
+	pthread_mutex_lock(&mutex);
+	for (size_t i = 0; i < rings.num && !tr; i++) {
+		if (!rings.array[i]->owned) {
+			tr = rings.array[i];
+			tr->ring.n_pushed = 0;
+			snprintf(tr->ring.thread_name, sizeof(tr->ring.thread_name), "%s", name);
+		}
+	}
+	if (!tr && rings.num < MAX_THREADS) {
+		tr = bzalloc(sizeof(struct thread_ring));
+		if (cm_trace_ring_init(&tr->ring, events_per_thread, (uint32_t)rings.num + 1, name)) {
+			da_push_back(rings, &tr);
+		} else {
+			bfree(tr);
+			tr = NULL;
+		}
+	}
+	if (tr)
+		tr->owned = true;
+	pthread_mutex_unlock(&mutex);
+
+	if (!tr)
+		blog(LOG_WARNING, "trace: cannot record more than %d threads at the same time", MAX_THREADS);
+	return tr;
+}
+
+void cm_trace_record(const char *name, char phase, int64_t arg)
+{
+	if (!thread_ring) {
+		if (thread_overflow)
+			return;
+		thread_ring = create_thread_ring();
+		if (!thread_ring) {
+			thread_overflow = true;
+			return;
+		}
+		thread_generation = os_atomic_load_long(&generation);
+	}
+
+	// The dump clears `cm_trace_enabled` and then waits while `busy` is set; either this thread sees the
+	// recording paused, or the dump waits for the push.
+	struct thread_ring *tr = thread_ring;
+	os_atomic_set_bool(&tr->busy, true);
+	if (os_atomic_load_bool(&cm_trace_enabled)) {
+		const long gen = os_atomic_load_long(&generation);
+		if (thread_generation != gen) {
+			// Only the owning thread writes the ring.
+			tr->ring.n_pushed = 0;
+			thread_generation = gen;
+		}
+
+		cm_trace_ring_push(&tr->ring, name, phase, os_gettime_ns(), arg);
+	}
+	os_atomic_set_bool(&tr->busy, false);
+}
+
+void cm_trace_thread_exit(void)
+{
+	if (!thread_ring)
+		return;
+
+	// The events stay in the ring until another thread takes it over.
+	pthread_mutex_lock(&mutex);
+	thread_ring->owned = false;
+	pthread_mutex_unlock(&mutex);
+	thread_ring = NULL;
+}
+
+static void start_trace(void)
+{
+	pthread_mutex_lock(&mutex);
+	if (!cm_trace_enabled) {
+		ts_origin = os_gettime_ns();
+		os_atomic_inc_long(&generation);
+		cm_trace_enabled = true;
+		blog(LOG_INFO, "trace: started, %u events per thread", events_per_thread);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+static void stop_trace(void)
+{
+	pthread_mutex_lock(&mutex);
+	if (cm_trace_enabled) {
+		cm_trace_enabled = false;
+		blog(LOG_INFO, "trace: stopped");
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+static bool dump_trace(const char *path)
+{
+	FILE *fp = os_fopen(path, "wb");
+	if (!fp) {
+		blog(LOG_ERROR, "trace: failed to open '%s'", path);
+		return false;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	// Pause the recording and wait for the pushes in progress so that the rings are not written while reading.
+	const bool enabled = os_atomic_set_bool(&cm_trace_enabled, false);
+	DARRAY(struct cm_trace_ring *) dump_rings;
+	da_init(dump_rings);
+	for (size_t i = 0; i < rings.num; i++) {
+		while (os_atomic_load_bool(&rings.array[i]->busy))
+			os_sleep_ms(0);
+		struct cm_trace_ring *ring = &rings.array[i]->ring;
+		da_push_back(dump_rings, &ring);
+	}
+
+	bool ret = cm_trace_write_json(fp, dump_rings.array, dump_rings.num, ts_origin);
+	da_free(dump_rings);
+
+	os_atomic_set_bool(&cm_trace_enabled, enabled);
+	pthread_mutex_unlock(&mutex);
+
+	if (fclose(fp) != 0)
+		ret = false;
+
+	if (ret)
+		blog(LOG_INFO, "trace: written to '%s'", path);
+	else
+		blog(LOG_ERROR, "trace: failed to write '%s'", path);
+	return ret;
+}
+
+static void cb_trace_start(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(cd);
+	start_trace();
+}
+
+static void cb_trace_stop(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(cd);
+	stop_trace();
+}
+
+static void cb_trace_dump(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(data);
+	const char *path = calldata_string(cd, "path");
+	bool success = path && *path && dump_trace(path);
+	calldata_set_bool(cd, "success", success);
+}
+
+void cm_trace_init(uint32_t n_events)
+{
+	events_per_thread = n_events;
+	if (!events_per_thread)
+		return;
+
+	proc_handler_t *ph = obs_get_proc_handler();
+	proc_handler_add(ph, "void colormonitor_trace_start()", cb_trace_start, NULL);
+	proc_handler_add(ph, "void colormonitor_trace_stop()", cb_trace_stop, NULL);
+	proc_handler_add(ph, "void colormonitor_trace_dump(in string path, out bool success)", cb_trace_dump, NULL);
+}
+
+void cm_trace_free(void)
+{
+	pthread_mutex_lock(&mutex);
+	cm_trace_enabled = false;
+	for (size_t i = 0; i < rings.num; i++) {
+		cm_trace_ring_free(&rings.array[i]->ring);
+		bfree(rings.array[i]);
+	}
+	da_free(rings);
+	pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Trace of the pipeline, dumped as a Chrome trace JSON file.
+ * Each thread records into its own ring buffer; see trace-buffer.h.
+ * When the trace is not started, recording an event costs one load and a branch.
+ * The trace is controlled by the procedures of the global procedure handler;
+ *   void colormonitor_trace_start()
+ *   void colormonitor_trace_stop()
+ *   void colormonitor_trace_dump(in string path, out bool success)
+ */
+
+extern volatile bool cm_trace_enabled;
+
+void cm_trace_init(uint32_t events_per_thread);
+void cm_trace_free(void);
+
+void cm_trace_record(const char *name, char phase, int64_t arg);
+
+// Names the rings created by the calling thread afterwards.
+void cm_trace_set_thread_name(const char *name);
+
+// Releases the ring of the calling thread so that another thread can take it over. Called before the thread exits.
+void cm_trace_thread_exit(void);
+
+static inline void cm_trace_begin(const char *name)
+{
+	if (cm_trace_enabled)
+		cm_trace_record(name, 'B', 0);
+}
+
+static inline void cm_trace_end(const char *name)
+{
+	if (cm_trace_enabled)
+		cm_trace_record(name, 'E', 0);
+}
+
+static inline void cm_trace_instant(const char *name, int64_t arg)
+{
+	if (cm_trace_enabled)
+		cm_trace_record(name, 'i', arg);
+}
+
+/*
+ * The profiler of libobs and the trace share the sites.
+ * `x` has to be a static string.
+ */
+#ifdef ENABLE_PROFILE
+#define PROFILE_START(x)             \
+	do {                         \
+		profile_start(x);    \
+		cm_trace_begin(x);   \
+	} while (0)
+#define PROFILE_END(x)             \
+	do {                       \
+		cm_trace_end(x);   \
+		profile_end(x);    \
+	} while (0)
+#else // ENABLE_PROFILE
+#define PROFILE_START(x) cm_trace_begin(x)
+#define PROFILE_END(x) cm_trace_end(x)
+#endif // ! ENABLE_PROFILE
+
+#ifdef __cplusplus
+}
+#endif
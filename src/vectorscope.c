@@ -6,24 +6,21 @@
 #include "obs-convenience.h"
 #include "common.h"
 #include "util.h"
+#include "worker-pool.h"
+#include "vectorscope-kernel.h"
+#include "trace.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "vss_render";
 static const char *prof_draw_vectorscope_name = "draw_vectorscope";
 static const char *prof_draw_name = "draw";
 static const char *prof_draw_graticule_name = "graticule";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
-#define VS_SIZE 256
+#define VS_SIZE VSS_KERNEL_SIZE
 #define N_GRATICULES 18
 #define GRATICULES_IQ 256
 #define GRATICULES_COLOR_MASK 3
 #define SKIN_TONE_LINE 0x0054FF // BGR
+#define BAND_MIN_PIXELS 65536
 
 #define RGB2Y_601(r, g, b) ((+306 * (r) + 601 * (g) + 117 * (b)) / 1024 + 0)
 #define RGB2U_601(r, g, b) ((-150 * (r) - 296 * (g) + 448 * (b)) / 1024 + 128)
@@ -46,6 +43,10 @@ struct vss_source
 	uint8_t *tex_buf[2];
 	int tex_cs[2];
 	volatile int w_tex_buf;
+	volatile long tex_seq; // incremented when tex_buf is written
+	long tex_seq_uploaded; // graphics thread
+	uint8_t *band_buf;
+	uint32_t band_buf_n;
 
 	gs_image_file_t graticule_img;
 	gs_vertbuffer_t *graticule_vbuf;
@@ -76,7 +77,7 @@ static void *vss_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct vss_source *src = bzalloc(sizeof(struct vss_source));
 
-	src->cm.flags = CM_FLAG_CONVERT_YUV;
+	src->cm.flags = CM_FLAG_CONVERT_UV;
 	src->zoom = 1.0f;
 	cm_create(&src->cm, settings, source);
 	cm_request(&src->cm, vss_surface_cb, src);
@@ -118,6 +119,7 @@ static void vss_destroy(void *data)
 
 	bfree(src->tex_buf[0]);
 	bfree(src->tex_buf[1]);
+	bfree(src->band_buf);
 	bfree(src);
 }
 
@@ -150,10 +152,13 @@ static void vss_update(void *data, obs_data_t *settings)
 		src->graticule_skintone_color = graticule_skintone_color;
 		src->update_graticule = 1;
 	}
+
+	cm_request_refresh(&src->cm);
 }
 
 static void vss_get_defaults_v1(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "target_scale", 2);
 	obs_data_set_default_int(settings, "intensity", 25);
 	obs_data_set_default_int(settings, "graticule", 1 | GRATICULES_IQ);
@@ -214,27 +219,49 @@ static uint32_t vss_get_height(void *data)
 	return src->cm.bypass ? cm_bypass_get_height(&src->cm) : VS_SIZE;
 }
 
-static inline void vss_draw_vectorscope(uint8_t *dbuf, struct cm_surface_data *surface_data)
+struct vss_band_ctx
+{
+	const struct cm_surface_data *surface_data;
+	uint8_t *band_buf;
+};
+
+static void vss_draw_band(void *data, uint32_t index, uint32_t n_bands)
+{
+	struct vss_band_ctx *ctx = data;
+	const uint32_t height = ctx->surface_data->height;
+	uint8_t *dbuf = ctx->band_buf + VS_SIZE * VS_SIZE * index;
+
+	memset(dbuf, 0, VS_SIZE * VS_SIZE);
+	vss_kernel_rows(dbuf, ctx->surface_data, height * index / n_bands, height * (index + 1) / n_bands);
+}
+
+static inline void vss_draw_vectorscope(struct vss_source *src, uint8_t *dbuf, struct cm_surface_data *surface_data)
 {
 	for (int i = 0; i < VS_SIZE * VS_SIZE; i++)
 		dbuf[i] = 0;
 
 	const uint32_t height = surface_data->height;
 	const uint32_t width = surface_data->width;
-	uint8_t *vd = surface_data->yuv_data;
-	uint32_t vd_add = surface_data->linesize - width * 4;
-	for (uint32_t y = 0; y < height; y++) {
-		for (uint32_t x = 0; x < width; x++) {
-			const uint8_t u = *vd++;
-			/*            b */ vd++;
-			const uint8_t v = *vd++;
-			/*            a */ vd++;
-			uint8_t *c = dbuf + (u + VS_SIZE * (255 - v));
-			if (*c < 255)
-				++*c;
-		}
-		vd += vd_add;
+	const uint32_t n_bands = width ? cm_worker_n_bands(height, (BAND_MIN_PIXELS + width - 1) / width) : 1;
+	if (n_bands <= 1) {
+		vss_kernel_rows(dbuf, surface_data, 0, height);
+		return;
+	}
+
+	if (src->band_buf_n < n_bands) {
+		bfree(src->band_buf);
+		src->band_buf = bmalloc(VS_SIZE * VS_SIZE * n_bands);
+		src->band_buf_n = n_bands;
 	}
+
+	struct vss_band_ctx ctx = {
+		.surface_data = surface_data,
+		.band_buf = src->band_buf,
+	};
+	cm_worker_run(vss_draw_band, &ctx, n_bands);
+
+	for (uint32_t j = 0; j < n_bands; j++)
+		vss_kernel_merge(dbuf, src->band_buf + VS_SIZE * VS_SIZE * j);
 }
 
 static void vss_set_image(struct vss_source *src, const uint8_t *tex_buf)
@@ -249,19 +276,20 @@ static void vss_surface_cb(void *data, struct cm_surface_data *surface_data)
 {
 	struct vss_source *src = data;
 
-	if (!surface_data->yuv_data)
+	if (!surface_data->u_data)
 		return;
 
 	if (!src->tex_buf[src->w_tex_buf])
 		src->tex_buf[src->w_tex_buf] = bzalloc(VS_SIZE * VS_SIZE);
 
 	PROFILE_START(prof_draw_vectorscope_name);
-	vss_draw_vectorscope(src->tex_buf[src->w_tex_buf], surface_data);
+	vss_draw_vectorscope(src, src->tex_buf[src->w_tex_buf], surface_data);
 	PROFILE_END(prof_draw_vectorscope_name);
 
 	src->tex_cs[src->w_tex_buf] = surface_data->colorspace;
 
 	src->w_tex_buf ^= 1;
+	os_atomic_inc_long(&src->tex_seq);
 }
 
 static void create_graticule_vbuf(struct vss_source *src, int colorspace)
@@ -407,9 +435,14 @@ static void vss_render(void *data, gs_effect_t *effect)
 	}
 
 	PROFILE_START(prof_draw_name);
+	const long seq = os_atomic_load_long(&src->tex_seq);
 	int r_tex_buf = src->w_tex_buf ^ 1;
 	if (src->tex_buf[r_tex_buf] && src->effect) {
-		vss_set_image(src, src->tex_buf[r_tex_buf]);
+		// Static frames are not analyzed again; upload only a new result.
+		if (!src->tex_vs || seq != src->tex_seq_uploaded) {
+			vss_set_image(src, src->tex_buf[r_tex_buf]);
+			src->tex_seq_uploaded = seq;
+		}
 
 		gs_effect_t *effect = src->effect;
 		gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), src->tex_vs);
@@ -4,20 +4,18 @@
 #include <graphics/matrix4.h>
 #include "common.h"
 #include "util.h"
+#include "worker-pool.h"
+#include "waveform-kernel.h"
+#include "trace.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "wvs_render";
 static const char *prof_draw_waveform_name = "draw_waveform";
 static const char *prof_draw_name = "draw";
 static const char *prof_draw_graticule_name = "graticule";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
-#define WV_SIZE 256
+#define WV_SIZE WVS_KERNEL_SIZE
+#define BAND_MIN_PIXELS 65536
+#define BAND_ALIGN 16 // columns; a band starts at a cache line of the output
 
 #define DISP_OVERLAY 0
 #define DISP_STACK 1
@@ -39,6 +37,8 @@ struct wvs_source
 	uint32_t tex_buf_width[2];
 	volatile int w_tex_buf;
 	int r_tex_buf;
+	volatile long tex_seq; // incremented when tex_buf is written
+	long r_tex_seq, tex_seq_uploaded; // graphics thread
 
 	gs_vertbuffer_t *graticule_line_vbuf;
 
@@ -46,6 +46,7 @@ struct wvs_source
 	uint32_t components;
 	int intensity;
 	int graticule_lines, graticule_lines_prev;
+	uint32_t columns;
 };
 
 static void wvs_update(void *, obs_data_t *);
@@ -99,17 +100,23 @@ static void wvs_update(void *data, obs_data_t *settings)
 
 	src->components = (uint32_t)obs_data_get_int(settings, "components");
 	src->cm.flags = (src->components & COMP_RGB ? CM_FLAG_CONVERT_RGB : 0) |
-			(src->components & COMP_YUV ? CM_FLAG_CONVERT_YUV : 0);
+			(src->components & COMP_Y ? CM_FLAG_CONVERT_Y : 0) |
+			(src->components & COMP_UV ? CM_FLAG_CONVERT_UV : 0);
 
 	src->intensity = (int)obs_data_get_int(settings, "intensity");
 	if (src->intensity < 1)
 		src->intensity = 1;
 
+	src->columns = (uint32_t)obs_data_get_int(settings, "columns");
+
 	src->graticule_lines = (int)obs_data_get_int(settings, "graticule_lines");
+
+	cm_request_refresh(&src->cm);
 }
 
 static void wvs_get_defaults(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "target_scale", 2);
 	obs_data_set_default_int(settings, "intensity", 51);
 	obs_data_set_default_int(settings, "components", COMP_RGB);
@@ -156,6 +163,13 @@ static obs_properties_t *wvs_get_properties(void *data)
 	// TODO: Disable this property if ROI target is selected.
 	properties_add_colorspace(props, "colorspace", obs_module_text("Color space"));
 
+	prop = obs_properties_add_list(props, "columns", obs_module_text("WV.Prop.Columns"), OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("WV.Prop.Columns.Native"), 0);
+	obs_property_list_add_int(prop, "256", 256);
+	obs_property_list_add_int(prop, "512", 512);
+	obs_property_list_add_int(prop, "1024", 1024);
+
 	obs_properties_add_int(props, "intensity", obs_module_text("Intensity"), 1, 255, 1);
 	prop = obs_properties_add_list(props, "graticule_lines", obs_module_text("Graticule"), OBS_COMBO_TYPE_LIST,
 				       OBS_COMBO_FORMAT_INT);
@@ -198,12 +212,6 @@ static uint32_t wvs_get_height(void *data)
 	return WV_SIZE;
 }
 
-static inline void inc_uint8(uint8_t *c)
-{
-	if (*c < 255)
-		++*c;
-}
-
 static inline void ensure_tex_buf_size(struct wvs_source *src, const uint32_t width, int ix)
 {
 	if (src->tex_buf[ix] && src->tex_buf_width[ix] == width)
@@ -217,43 +225,55 @@ static inline void ensure_tex_buf_size(struct wvs_source *src, const uint32_t wi
 	src->tex_buf_width[ix] = width;
 }
 
-static inline void wvs_draw_waveform(struct wvs_source *src, uint8_t *dbuf, const struct cm_surface_data *surface_data)
+struct wvs_band_ctx
+{
+	const struct wvs_source *src;
+	uint8_t *dbuf;
+	const struct cm_surface_data *surface_data;
+	uint32_t out_width;
+};
+
+static void wvs_draw_band(void *data, uint32_t index, uint32_t n_bands)
+{
+	struct wvs_band_ctx *ctx = data;
+	const uint32_t out_width = ctx->out_width;
+	const uint32_t o0 = index ? (out_width * index / n_bands) & ~(BAND_ALIGN - 1) : 0;
+	const uint32_t o1 = index + 1 < n_bands ? (out_width * (index + 1) / n_bands) & ~(BAND_ALIGN - 1) : out_width;
+
+	wvs_kernel_columns(ctx->dbuf, ctx->surface_data, ctx->src->components, out_width, o0, o1);
+}
+
+static inline uint32_t wvs_out_width(const struct wvs_source *src, uint32_t width)
+{
+	if (src->columns && src->columns < width)
+		return src->columns;
+	return width;
+}
+
+static inline void wvs_draw_waveform(struct wvs_source *src, uint8_t *dbuf, uint32_t out_width,
+				     const struct cm_surface_data *surface_data)
 {
 	const uint32_t height = surface_data->height;
 	const uint32_t width = surface_data->width;
 
-	for (uint32_t i = 0; i < width * WV_SIZE * 4; i++)
-		dbuf[i] = 0;
-
-	const uint8_t *video_data = NULL;
-	if (src->components & COMP_RGB)
-		video_data = surface_data->rgb_data;
-	else if (src->components & COMP_YUV)
-		video_data = surface_data->yuv_data;
-	if (!video_data)
+	if (!(src->components & (COMP_RGB | COMP_YUV))) {
+		memset(dbuf, 0, out_width * WV_SIZE * 4);
 		return;
-
-	const bool calc_b = (src->components & 0x11) ? true : false;
-	const bool calc_g = (src->components & 0x22) ? true : false;
-	const bool calc_r = (src->components & 0x44) ? true : false;
-
-	for (uint32_t y = 0; y < height; y++) {
-		const uint8_t *v = video_data + surface_data->linesize * y;
-		for (uint32_t x = 0; x < width; x++) {
-			const uint8_t b = *v++;
-			const uint8_t g = *v++;
-			const uint8_t r = *v++;
-			const uint8_t a = *v++;
-			if (!a)
-				continue;
-			if (calc_b)
-				inc_uint8(dbuf + x * 4 + (WV_SIZE - 1 - b) * width * 4 + 0);
-			if (calc_g)
-				inc_uint8(dbuf + x * 4 + (WV_SIZE - 1 - g) * width * 4 + 1);
-			if (calc_r)
-				inc_uint8(dbuf + x * 4 + (WV_SIZE - 1 - r) * width * 4 + 2);
-		}
 	}
+
+	/* Every column of `dbuf` is overwritten by the transposition of its tile.
+	 * Each band has its own columns of the output so that no reduction is required. */
+	const uint32_t column_pixels = height * (width / out_width);
+	const uint32_t min_blocks =
+		column_pixels ? (BAND_MIN_PIXELS / BAND_ALIGN + column_pixels - 1) / column_pixels : 0;
+	const uint32_t n_bands = min_blocks ? cm_worker_n_bands(out_width / BAND_ALIGN, min_blocks) : 1;
+	struct wvs_band_ctx ctx = {
+		.src = src,
+		.dbuf = dbuf,
+		.surface_data = surface_data,
+		.out_width = out_width,
+	};
+	cm_worker_run(wvs_draw_band, &ctx, n_bands);
 }
 
 static void wvs_set_image(struct wvs_source *src, const uint8_t *tex_buf, uint32_t width)
@@ -275,17 +295,21 @@ static void wvs_surface_cb(void *data, struct cm_surface_data *surface_data)
 
 	if ((src->components & COMP_RGB) && !surface_data->rgb_data)
 		return;
-	if ((src->components & COMP_YUV) && !surface_data->yuv_data)
+	if ((src->components & COMP_Y) && !surface_data->y_data)
+		return;
+	if ((src->components & COMP_UV) && !surface_data->u_data)
 		return;
 	if (!surface_data->width)
 		return;
 
-	ensure_tex_buf_size(src, surface_data->width, src->w_tex_buf);
+	const uint32_t out_width = wvs_out_width(src, surface_data->width);
+	ensure_tex_buf_size(src, out_width, src->w_tex_buf);
 
 	PROFILE_START(prof_draw_waveform_name);
-	wvs_draw_waveform(src, src->tex_buf[src->w_tex_buf], surface_data);
+	wvs_draw_waveform(src, src->tex_buf[src->w_tex_buf], out_width, surface_data);
 	PROFILE_END(prof_draw_waveform_name);
 	src->w_tex_buf ^= 1;
+	os_atomic_inc_long(&src->tex_seq);
 }
 
 static void create_graticule_vbuf(struct wvs_source *src)
@@ -373,7 +397,11 @@ static void wvs_render(void *data, gs_effect_t *effect)
 
 	PROFILE_START(prof_draw_name);
 	if (src->tex_buf[src->r_tex_buf]) {
-		wvs_set_image(src, src->tex_buf[src->r_tex_buf], src->tex_buf_width[src->r_tex_buf]);
+		// Static frames are not analyzed again; upload only a new result.
+		if (!src->tex_wv || src->r_tex_seq != src->tex_seq_uploaded) {
+			wvs_set_image(src, src->tex_buf[src->r_tex_buf], src->tex_buf_width[src->r_tex_buf]);
+			src->tex_seq_uploaded = src->r_tex_seq;
+		}
 		render_waveform(src);
 	}
 	PROFILE_END(prof_draw_name);
@@ -396,6 +424,7 @@ static void wvs_tick(void *data, float second)
 	struct wvs_source *src = data;
 	cm_tick(data, second);
 
+	src->r_tex_seq = os_atomic_load_long(&src->tex_seq);
 	src->r_tex_buf = src->w_tex_buf ^ 1;
 }
 
@@ -0,0 +1,163 @@
+#include <obs-module.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "worker-pool.h"
+#include "trace.h"
+
+#define MAX_THREADS 64
+
+struct cm_worker_job
+{
+	cm_worker_func_t func;
+	void *data;
+	uint32_t n_tasks;
+	uint32_t next;
+	uint32_t done;
+	struct cm_worker_job *next_job;
+};
+
+static struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_job;
+	pthread_cond_t cond_done;
+	struct cm_worker_job *head, *tail;
+	pthread_t threads[MAX_THREADS];
+	int n_threads;
+	bool request_exit;
+} pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond_job = PTHREAD_COND_INITIALIZER,
+	.cond_done = PTHREAD_COND_INITIALIZER,
+};
+
+// Takes one task from the job. Must be called with the mutex locked.
+static uint32_t job_take_unlocked(struct cm_worker_job *job)
+{
+	uint32_t index = job->next++;
+	if (job->next >= job->n_tasks) {
+		// All tasks are taken; the job does not need to be visible from other threads.
+		struct cm_worker_job **pp = &pool.head;
+		while (*pp && *pp != job)
+			pp = &(*pp)->next_job;
+		if (*pp) {
+			*pp = job->next_job;
+			if (pool.tail == job) {
+				pool.tail = NULL;
+				for (struct cm_worker_job *j = pool.head; j; j = j->next_job)
+					pool.tail = j;
+			}
+		}
+	}
+	return index;
+}
+
+static void job_execute_unlocked(struct cm_worker_job *job, uint32_t index)
+{
+	pthread_mutex_unlock(&pool.mutex);
+	cm_trace_begin("band");
+	job->func(job->data, index, job->n_tasks);
+	cm_trace_end("band");
+	pthread_mutex_lock(&pool.mutex);
+
+	if (++job->done == job->n_tasks)
+		pthread_cond_broadcast(&pool.cond_done);
+}
+
+static void *worker_thread(void *data)
+{
+	UNUSED_PARAMETER(data);
+	os_set_thread_name("color-monitor-worker");
+	cm_trace_set_thread_name("color-monitor-worker");
+
+	pthread_mutex_lock(&pool.mutex);
+	while (!pool.request_exit) {
+		struct cm_worker_job *job = pool.head;
+		if (!job) {
+			pthread_cond_wait(&pool.cond_job, &pool.mutex);
+			continue;
+		}
+
+		uint32_t index = job_take_unlocked(job);
+		job_execute_unlocked(job, index);
+	}
+	pthread_mutex_unlock(&pool.mutex);
+
+	cm_trace_thread_exit();
+	return NULL;
+}
+
+void cm_worker_pool_init(int n_threads)
+{
+	if (n_threads <= 0) {
+		n_threads = os_get_logical_cores() / 2;
+		if (n_threads > 8)
+			n_threads = 8;
+	}
+
+	// The calling thread also works on its job.
+	n_threads -= 1;
+	if (n_threads > MAX_THREADS)
+		n_threads = MAX_THREADS;
+
+	pool.request_exit = false;
+	for (int i = 0; i < n_threads; i++) {
+		if (pthread_create(&pool.threads[pool.n_threads], NULL, worker_thread, NULL) != 0) {
+			blog(LOG_ERROR, "failed to create worker thread");
+			break;
+		}
+		pool.n_threads++;
+	}
+
+	blog(LOG_INFO, "%d worker threads are started", pool.n_threads);
+}
+
+void cm_worker_pool_free(void)
+{
+	pthread_mutex_lock(&pool.mutex);
+	pool.request_exit = true;
+	pthread_cond_broadcast(&pool.cond_job);
+	pthread_mutex_unlock(&pool.mutex);
+
+	for (int i = 0; i < pool.n_threads; i++)
+		pthread_join(pool.threads[i], NULL);
+	pool.n_threads = 0;
+}
+
+uint32_t cm_worker_pool_size(void)
+{
+	return (uint32_t)pool.n_threads + 1;
+}
+
+void cm_worker_run(cm_worker_func_t func, void *data, uint32_t n_tasks)
+{
+	if (n_tasks <= 1 || !pool.n_threads) {
+		for (uint32_t i = 0; i < n_tasks; i++)
+			func(data, i, n_tasks);
+		return;
+	}
+
+	struct cm_worker_job job = {
+		.func = func,
+		.data = data,
+		.n_tasks = n_tasks,
+	};
+
+	pthread_mutex_lock(&pool.mutex);
+	if (pool.tail)
+		pool.tail->next_job = &job;
+	else
+		pool.head = &job;
+	pool.tail = &job;
+	pthread_cond_broadcast(&pool.cond_job);
+
+	while (job.next < job.n_tasks) {
+		uint32_t index = job_take_unlocked(&job);
+		job_execute_unlocked(&job, index);
+	}
+
+	while (job.done < job.n_tasks)
+		pthread_cond_wait(&pool.cond_done, &pool.mutex);
+	pthread_mutex_unlock(&pool.mutex);
+}
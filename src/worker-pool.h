@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shared pool of worker threads to split an analysis of one frame into bands.
+ * `func` is called for each `index` in `[0, n_tasks)` from the pool threads and the calling thread.
+ * `cm_worker_run` returns after all tasks are finished.
+ */
+typedef void (*cm_worker_func_t)(void *data, uint32_t index, uint32_t n_tasks);
+
+void cm_worker_pool_init(int n_threads);
+void cm_worker_pool_free(void);
+
+// Returns the number of threads that can work on one job, including the calling thread.
+uint32_t cm_worker_pool_size(void);
+
+void cm_worker_run(cm_worker_func_t func, void *data, uint32_t n_tasks);
+
+// Returns the number of bands to split `n_items` so that each band has at least `min_items`.
+static inline uint32_t cm_worker_n_bands(uint32_t n_items, uint32_t min_items)
+{
+	uint32_t n = cm_worker_pool_size();
+	if (min_items && n_items / min_items < n)
+		n = n_items / min_items;
+	return n ? n : 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
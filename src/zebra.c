@@ -7,15 +7,9 @@
 #include "obs-convenience.h"
 #include "common.h"
 #include "util.h"
+#include "trace.h"
 
-#ifdef ENABLE_PROFILE
-#define PROFILE_START(x) profile_start(x)
-#define PROFILE_END(x) profile_end(x)
 static const char *prof_render_name = "zebra_render";
-#else // ENABLE_PROFILE
-#define PROFILE_START(x)
-#define PROFILE_END(x)
-#endif // ! ENABLE_PROFILE
 
 enum show_key_e {
 	show_key_none = 0,
@@ -228,6 +222,7 @@ static void zbf_update(void *data, obs_data_t *settings)
 
 static void zb_get_defaults(obs_data_t *settings)
 {
+	cm_get_defaults(settings);
 	obs_data_set_default_int(settings, "zebra_th_low", 75);
 	obs_data_set_default_int(settings, "zebra_th_high", 100);
 }